@@ -0,0 +1,54 @@
+#!/bin/sh
+# Compares benchmark results with a baseline, both written by suite.sh.
+#
+#   ./compare.sh <baseline.json> <results.json>
+#
+# Prints every baseline result next to the new one and fails if any result
+# is missing or worse than the baseline by more than BENCH_TOLERANCE percent
+# (default 25). The baseline is only meaningful on the machine it was
+# recorded on; refresh it there with make bench-baseline.
+
+if [ $# -ne 2 ] || [ ! -r "$1" ] || [ ! -r "$2" ]; then
+  echo "Usage: $0 <baseline.json> <results.json>" >&2
+  exit 1
+fi
+
+awk -v tolerance="${BENCH_TOLERANCE:-25}" '
+  # Every result is on one line: {"name": ..., "better": ..., "value": ...}
+  function field(line, key,    rest) {
+    rest = substr(line, index(line, "\"" key "\": ") + length(key) + 4)
+    sub(/^"/, "", rest)
+    sub(/["},].*$/, "", rest)
+    return rest
+  }
+  !/"name": / { next }
+  FNR == NR {
+    name = field($0, "name")
+    order[++count] = name
+    base[name] = field($0, "value")
+    better[name] = field($0, "better")
+    next
+  }
+  { current[field($0, "name")] = field($0, "value") }
+  END {
+    failed = 0
+    printf "%-40s %12s %12s %8s\n", "result", "baseline", "current", "change"
+    for (i = 1; i <= count; i++) {
+      name = order[i]
+      if (!(name in current)) {
+        printf "%-40s %12s %12s %8s  MISSING\n", name, base[name], "-", "-"
+        failed = 1
+        continue
+      }
+      change = base[name] == 0 ? 0 : \
+               (current[name] - base[name]) * 100 / base[name]
+      # Positive loss means the result got worse
+      loss = better[name] == "higher" ? -change : change
+      status = loss > tolerance ? "REGRESSION" : ""
+      if (status != "") failed = 1
+      printf "%-40s %12s %12s %+7.1f%%  %s\n", name, base[name],
+             current[name], change, status
+    }
+    if (failed) printf "Performance regressed beyond %s%%\n", tolerance
+    exit failed
+  }' "$1" "$2"
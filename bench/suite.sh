@@ -0,0 +1,206 @@
+#!/bin/sh
+# Benchmarks lab1, lab2 and lab3 and prints the results as JSON.
+#
+#   ./suite.sh [-q] <bindir>
+#
+# bindir holds lab1, lab2, server and loadgen, e.g. build/release. Every case
+# runs BENCH_RUNS times (default 3) and keeps its best value, which is the
+# least disturbed by other load on the machine. -q runs every case once on
+# smaller inputs, enough to train the pgo profile. Results:
+#   lab1/<mode>/latency_ms        one query over generated archives: the ar|grep
+#                                 pipeline, native reading, and a warm index
+#                                 cache
+#   lab2/<mode>/n=<n>/threads=<t> million grid nodes per second of wall time;
+#                                 explicit counts every node of every time step,
+#                                 vcycle and fmg the nodes of the solved grid
+#   lab3/<transport>/...          connections and requests per second and the
+#                                 median request latency of loadgen against a
+#                                 local server; tcp+wal logs every game
+# The server listens on BENCH_PORT (default 18080) and the port after it.
+
+QUICK=
+while getopts "q" opt; do
+  case $opt in
+  q) QUICK=1 ;;
+  *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+BIN=$1
+if [ -z "$BIN" ] || [ ! -x "$BIN/lab1" ] || [ ! -x "$BIN/lab2" ] ||
+  [ ! -x "$BIN/server" ] || [ ! -x "$BIN/loadgen" ]; then
+  echo "Usage: $0 [-q] <bindir>" >&2
+  echo "bindir must hold lab1, lab2, server and loadgen; run make first." >&2
+  exit 1
+fi
+
+RUNS=${BENCH_RUNS:-3}
+PORT=${BENCH_PORT:-18080}
+CPUS=$(nproc 2>/dev/null || echo 1)
+if [ -n "$QUICK" ]; then
+  RUNS=1
+fi
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/bench.XXXXXX")
+SERVER=
+trap '[ -n "$SERVER" ] && kill $SERVER 2>/dev/null; rm -rf "$WORK"' EXIT
+RESULTS=$WORK/results
+
+now_ns() { date +%s%N; }
+
+# result <name> <unit> <lower|higher> <value>
+result() {
+  echo "$1 $2 $3 $4" >>"$RESULTS"
+  echo "$1: $4 $2" >&2
+}
+
+# best <lower|higher> <value>...
+best() {
+  better=$1
+  shift
+  echo "$@" | awk -v better="$better" '{
+    best = $1
+    for (i = 2; i <= NF; i++)
+      if ((better == "lower") == ($i < best)) best = $i
+    print best }'
+}
+
+# elapsed_us <command>...: wall time of the command in microseconds
+elapsed_us() {
+  start=$(now_ns)
+  "$@" >/dev/null 2>&1
+  echo $((($(now_ns) - start) / 1000))
+}
+
+# lab1 <mode> <lab1 options>...
+lab1() {
+  mode=$1
+  shift
+  times=
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    times="$times $(elapsed_us "$BIN/lab1" "$@" "$WORK/archives" "$PATTERN")"
+    i=$((i + 1))
+  done
+  result "lab1/$mode/latency_ms" ms lower \
+    "$(best lower $times | awk '{ printf "%.3f", $1 / 1000 }')"
+}
+
+# lab2 <mode> <size> <threads>
+lab2() {
+  rates=
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    us=$(elapsed_us "$BIN/lab2" "$3" 1 "$2" "$2" "$1")
+    # dt 1 gives the explicit solver 50 time steps
+    steps=1
+    [ "$1" = explicit ] && steps=50
+    rates="$rates $(awk -v n="$2" -v steps=$steps -v us="$us" \
+      'BEGIN { printf "%.3f", n * n * steps / us }')"
+    i=$((i + 1))
+  done
+  result "lab2/$1/n=$2/threads=$3/mnodes_per_s" Mnodes/s higher \
+    "$(best higher $rates)"
+}
+
+# start_server <server options>...
+start_server() {
+  "$BIN/server" "$@" -U "$WORK/game.sock" "$WORK/conf.txt" >/dev/null 2>&1 &
+  SERVER=$!
+  i=0
+  while [ ! -S "$WORK/game.sock" ] && [ $i -lt 50 ]; do
+    sleep 0.1
+    i=$((i + 1))
+  done
+}
+
+stop_server() {
+  kill $SERVER
+  wait $SERVER 2>/dev/null
+  SERVER=
+  rm -f "$WORK/game.sock"
+}
+
+# lab3 <name> <loadgen options>...
+lab3() {
+  name=$1
+  shift
+  connects= requests= latencies=
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    out=$("$BIN/loadgen" -h 127.0.0.1 -p "$PORT" -c "$CONNECTIONS" \
+      -g "$GAMES" -t 1 -n "bench$i-" "$@")
+    connects="$connects $(echo "$out" | awk '/^Connects:/ {
+      gsub(/[(]|[/]s[)]/, "", $3); print $3 }')"
+    requests="$requests $(echo "$out" | awk '/^Requests:/ {
+      gsub(/[(]|[/]s[)]/, "", $3); print $3 }')"
+    latencies="$latencies $(echo "$out" | awk '/^request/ { print $2 }')"
+    i=$((i + 1))
+  done
+  result "lab3/$name/connects_per_s" 1/s higher "$(best higher $connects)"
+  result "lab3/$name/requests_per_s" 1/s higher "$(best higher $requests)"
+  result "lab3/$name/request_p50_us" us lower "$(best lower $latencies)"
+}
+
+# lab1: archives of many small members, queried for a tenth of them
+ARCHIVES=50
+MEMBERS=400
+[ -n "$QUICK" ] && ARCHIVES=4
+mkdir -p "$WORK/members" "$WORK/archives"
+i=0
+while [ $i -lt $MEMBERS ]; do
+  echo "member $i" >"$WORK/members/member_$i.o"
+  i=$((i + 1))
+done
+a=0
+while [ $a -lt $ARCHIVES ]; do
+  echo "archive $a" >"$WORK/members/archive_$a.o"
+  (cd "$WORK/members" && ar rc "../archives/lib$a.a" member_*.o "archive_$a.o")
+  a=$((a + 1))
+done
+PATTERN='member_.*7$'
+lab1 pipeline
+lab1 native -n
+"$BIN/lab1" -c "$WORK/cache" "$WORK/archives" "$PATTERN" >/dev/null 2>&1
+lab1 cache -c "$WORK/cache"
+
+# lab2: every solver on one thread and on all CPUs
+THREADS=1
+[ "$CPUS" -gt 1 ] && THREADS="1 $CPUS"
+if [ -n "$QUICK" ]; then
+  SIZES_EXPLICIT=128 SIZES_MG=128
+else
+  SIZES_EXPLICIT=512 SIZES_MG="256 1024"
+fi
+for t in $THREADS; do
+  for n in $SIZES_EXPLICIT; do
+    lab2 explicit "$n" "$t"
+  done
+  for n in $SIZES_MG; do
+    lab2 vcycle "$n" "$t"
+    lab2 fmg "$n" "$t"
+  done
+done
+
+# lab3: enough attempts for loadgen's binary search to win every game
+CONNECTIONS=50
+GAMES=40
+[ -n "$QUICK" ] && GAMES=4
+echo "1 $PORT 20 20 1 1 1000000 1000000" >"$WORK/conf.txt"
+start_server
+lab3 tcp
+lab3 unix -u "$WORK/game.sock"
+stop_server
+start_server -W "$WORK/games.wal"
+lab3 tcp+wal
+stop_server
+
+awk -v profile="$(basename "$BIN")" -v cpus="$CPUS" '
+  { lines[NR] = sprintf("    {\"name\": \"%s\", \"unit\": \"%s\", " \
+                        "\"better\": \"%s\", \"value\": %s}", $1, $2, $3, $4) }
+  END {
+    printf "{\n  \"profile\": \"%s\",\n  \"cpus\": %d,\n  \"results\": [\n",
+           profile, cpus
+    for (i = 1; i <= NR; i++) printf "%s%s\n", lines[i], i < NR ? "," : ""
+    printf "  ]\n}\n"
+  }' "$RESULTS"
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Measures query latency of lab1 with and without the index cache.
+#
+#   ./cache.sh [-r runs] [-s] <archive|dir>... "<pattern>"
+#
+# Every mode runs the same query several times and reports the average and
+# the best wall time in milliseconds:
+#   pipeline  ar -t | grep for every archive
+#   native    archives read in-process on every run
+#   cold      cache removed before every run, so it is built each time
+#   warm      cache built once beforehand, queries never read an archive
+# With -s the symbol table is queried, which has no pipeline mode.
+
+LAB1=${LAB1:-$(dirname "$0")/../src/lab1}
+RUNS=10
+SYMBOLS=
+while getopts "r:s" opt; do
+  case $opt in
+  r) RUNS=$OPTARG ;;
+  s) SYMBOLS=-s ;;
+  *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+if [ $# -lt 2 ] || [ ! -x "$LAB1" ]; then
+  echo "Usage: $0 [-r runs] [-s] <archive|dir>... \"<pattern>\"" >&2
+  echo "Build $LAB1 first or point LAB1 at the binary." >&2
+  exit 1
+fi
+
+CACHE=$(mktemp -u "${TMPDIR:-/tmp}/lab1-bench.XXXXXX")
+trap 'rm -f "$CACHE"' EXIT
+
+now_ns() { date +%s%N; }
+
+# run <name> <setup command> <lab1 options>...
+run() {
+  name=$1 setup=$2
+  shift 2
+  total=0 best=
+  i=0
+  while [ $i -lt "$RUNS" ]; do
+    eval "$setup"
+    start=$(now_ns)
+    "$LAB1" "$@" >/dev/null 2>&1
+    elapsed=$((($(now_ns) - start) / 1000))
+    total=$((total + elapsed))
+    if [ -z "$best" ] || [ $elapsed -lt "$best" ]; then
+      best=$elapsed
+    fi
+    i=$((i + 1))
+  done
+  awk -v name="$name" -v total=$total -v best="$best" -v runs="$RUNS" \
+    'BEGIN { printf "%-10s avg %9.2f ms   best %9.2f ms\n", name,
+             total / runs / 1000, best / 1000 }'
+}
+
+if [ -z "$SYMBOLS" ]; then
+  run pipeline : "$@"
+fi
+run native : -n $SYMBOLS "$@"
+run cold 'rm -f "$CACHE"' -c "$CACHE" $SYMBOLS "$@"
+"$LAB1" -c "$CACHE" $SYMBOLS "$@" >/dev/null 2>&1
+run warm : -c "$CACHE" $SYMBOLS "$@"
@@ -0,0 +1,378 @@
+#include "arcache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arscan.h"
+
+#define CACHE_MAGIC "lab1idx\n"
+#define CACHE_VERSION 1
+#define CACHE_BYTE_ORDER 0x01020304u
+
+// On-disk layout. Integers are in host byte order, a cache written on a
+// machine with another byte order fails the byte_order check and is ignored.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t size;
+  uint32_t count;
+  uint32_t reserved;
+} cache_header;
+
+// Offsets are from the start of the file. The path is followed by a NUL.
+typedef struct {
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint32_t path, path_len;
+  uint32_t names, names_len;
+  uint32_t member_count, flags;
+  uint32_t symbols, symbols_len;
+  uint32_t symbol_members, symbol_count;
+} cache_entry;
+
+typedef struct {
+  FILE *names;
+  FILE *symbols;
+  uint32_t member_count;
+  uint32_t *members;
+  uint32_t symbol_count;
+  uint32_t capacity;
+} index_builder;
+
+static int add_member(const char *name, size_t len, void *ctx) {
+  index_builder *builder = ctx;
+  fwrite(name, 1, len, builder->names);
+  fputc('\n', builder->names);
+  builder->member_count++;
+  return 0;
+}
+
+static int add_symbol(const char *symbol, size_t len, int member, void *ctx) {
+  index_builder *builder = ctx;
+  if (builder->symbol_count == builder->capacity) {
+    uint32_t capacity = builder->capacity ? builder->capacity * 2 : 256;
+    uint32_t *resized =
+        realloc(builder->members, capacity * sizeof(uint32_t));
+    if (resized == NULL)
+      return 1;
+    builder->members = resized;
+    builder->capacity = capacity;
+  }
+  fwrite(symbol, 1, len, builder->symbols);
+  fputc('\n', builder->symbols);
+  builder->members[builder->symbol_count++] =
+      member == -1 ? AR_INDEX_NO_MEMBER : (uint32_t)member;
+  return 0;
+}
+
+int ar_index_build(const char *archive, const char *key, const struct stat *st,
+                   uint32_t flags, ar_index *index) {
+  memset(index, 0, sizeof(*index));
+  char *names = NULL, *symbols = NULL;
+  index_builder builder = {0};
+  builder.names = open_memstream(&names, &index->names_len);
+  builder.symbols = open_memstream(&symbols, &index->symbols_len);
+  char *path = strdup(key);
+
+  int result = -1;
+  if (builder.names == NULL || builder.symbols == NULL || path == NULL)
+    perror("malloc() failed");
+  else
+    result = ar_scan_file(archive, add_member,
+                          flags & AR_INDEX_SYMBOLS ? add_symbol : NULL,
+                          &builder);
+  if (builder.names != NULL)
+    fclose(builder.names);
+  if (builder.symbols != NULL)
+    fclose(builder.symbols);
+  if (result == -1) {
+    free(names);
+    free(symbols);
+    free(builder.members);
+    free(path);
+    memset(index, 0, sizeof(*index));
+    return -1;
+  }
+
+  index->path = path;
+  index->path_len = strlen(path);
+  index->size = (uint64_t)st->st_size;
+  index->mtime_sec = st->st_mtim.tv_sec;
+  index->mtime_nsec = st->st_mtim.tv_nsec;
+  index->flags = flags;
+  index->names = names;
+  index->member_count = builder.member_count;
+  index->symbols = symbols;
+  index->symbol_members = builder.members;
+  index->symbol_count = builder.symbol_count;
+  return 0;
+}
+
+int ar_index_current(const ar_index *index, const struct stat *st) {
+  return index->size == (uint64_t)st->st_size &&
+         index->mtime_sec == st->st_mtim.tv_sec &&
+         index->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+void ar_index_free(ar_index *index) {
+  free((void *)index->path);
+  free((void *)index->names);
+  free((void *)index->symbols);
+  free((void *)index->symbol_members);
+  memset(index, 0, sizeof(*index));
+}
+
+int ar_cache_open(ar_cache *cache, const char *path) {
+  memset(cache, 0, sizeof(*cache));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno != ENOENT)
+      perror(path);
+    return 0;
+  }
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(cache_header))
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "lab1: %s: ignoring invalid index cache\n", path);
+    return 0;
+  }
+
+  const cache_header *header = data;
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->byte_order != CACHE_BYTE_ORDER ||
+      header->size != (uint64_t)st.st_size ||
+      header->count > (st.st_size - sizeof(cache_header)) /
+                          sizeof(cache_entry)) {
+    fprintf(stderr, "lab1: %s: ignoring invalid index cache\n", path);
+    munmap(data, st.st_size);
+    return 0;
+  }
+  cache->data = data;
+  cache->size = st.st_size;
+  cache->count = header->count;
+  return 0;
+}
+
+static const cache_entry *entry_at(const ar_cache *cache, uint32_t i) {
+  return (const cache_entry *)(cache->data + sizeof(cache_header)) + i;
+}
+
+static int in_bounds(const ar_cache *cache, uint32_t offset, uint64_t len) {
+  return offset <= cache->size && len <= cache->size - offset;
+}
+
+static int compare_path(const char *a, size_t a_len, const char *b,
+                        size_t b_len) {
+  int order = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if (order != 0)
+    return order;
+  return a_len < b_len ? -1 : a_len > b_len;
+}
+
+// Converts an entry to an index pointing into the mapping, checking that
+// everything it refers to lies inside the file.
+static int load_entry(const ar_cache *cache, const cache_entry *entry,
+                      ar_index *index) {
+  if (!in_bounds(cache, entry->path, (uint64_t)entry->path_len + 1) ||
+      cache->data[entry->path + entry->path_len] != '\0' ||
+      !in_bounds(cache, entry->names, entry->names_len) ||
+      !in_bounds(cache, entry->symbols, entry->symbols_len) ||
+      !in_bounds(cache, entry->symbol_members,
+                 (uint64_t)entry->symbol_count * sizeof(uint32_t)) ||
+      entry->symbol_members % sizeof(uint32_t) != 0)
+    return -1;
+  index->path = cache->data + entry->path;
+  index->path_len = entry->path_len;
+  index->size = entry->size;
+  index->mtime_sec = entry->mtime_sec;
+  index->mtime_nsec = entry->mtime_nsec;
+  index->flags = entry->flags;
+  index->names = cache->data + entry->names;
+  index->names_len = entry->names_len;
+  index->member_count = entry->member_count;
+  index->symbols = cache->data + entry->symbols;
+  index->symbols_len = entry->symbols_len;
+  index->symbol_members =
+      (const uint32_t *)(cache->data + entry->symbol_members);
+  index->symbol_count = entry->symbol_count;
+  return 0;
+}
+
+int ar_cache_lookup(const ar_cache *cache, const char *path, ar_index *index) {
+  size_t len = strlen(path);
+  uint32_t lo = 0, hi = cache->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const cache_entry *entry = entry_at(cache, mid);
+    if (!in_bounds(cache, entry->path, entry->path_len))
+      return -1;
+    int order = compare_path(cache->data + entry->path, entry->path_len, path,
+                             len);
+    if (order == 0)
+      return load_entry(cache, entry, index);
+    if (order < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return -1;
+}
+
+// An index to be written and its position in the input, which decides which
+// of several indexes for the same path is kept.
+typedef struct {
+  const ar_index *index;
+  int order;
+} pending_entry;
+
+static int compare_pending(const void *a, const void *b) {
+  const pending_entry *x = a, *y = b;
+  int order = compare_path(x->index->path, x->index->path_len,
+                           y->index->path, y->index->path_len);
+  return order != 0 ? order : (x->order > y->order) - (x->order < y->order);
+}
+
+static size_t align4(size_t offset) { return (offset + 3) & ~(size_t)3; }
+
+static int write_padding(FILE *file, size_t *offset, size_t target) {
+  static const char zeros[4];
+  size_t len = target - *offset;
+  *offset = target;
+  return fwrite(zeros, 1, len, file) == len ? 0 : -1;
+}
+
+static int write_entries(FILE *file, const pending_entry *pending, int count) {
+  cache_header header = {CACHE_MAGIC, CACHE_VERSION, CACHE_BYTE_ORDER, 0,
+                         (uint32_t)count, 0};
+  size_t offset = sizeof(cache_header) + count * sizeof(cache_entry);
+  cache_entry *entries = calloc(count ? count : 1, sizeof(cache_entry));
+  if (entries == NULL)
+    return -1;
+
+  // The entry table comes first, so lay out the data before writing it.
+  for (int i = 0; i < count; i++) {
+    const ar_index *index = pending[i].index;
+    cache_entry *entry = &entries[i];
+    entry->size = index->size;
+    entry->mtime_sec = index->mtime_sec;
+    entry->mtime_nsec = index->mtime_nsec;
+    entry->member_count = index->member_count;
+    entry->flags = index->flags;
+    entry->symbol_count = index->symbol_count;
+    entry->path_len = index->path_len;
+    entry->names_len = index->names_len;
+    entry->symbols_len = index->symbols_len;
+    offset = align4(offset);
+    entry->symbol_members = offset;
+    offset += index->symbol_count * sizeof(uint32_t);
+    entry->path = offset;
+    offset += index->path_len + 1;
+    entry->names = offset;
+    offset += index->names_len;
+    entry->symbols = offset;
+    offset += index->symbols_len;
+  }
+  if (offset > UINT32_MAX) {
+    fprintf(stderr, "lab1: index cache would exceed 4 GiB\n");
+    free(entries);
+    return -1;
+  }
+  header.size = offset;
+
+  int result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(entries, sizeof(cache_entry), count, file) ==
+                           (size_t)count
+                   ? 0
+                   : -1;
+  offset = sizeof(cache_header) + count * sizeof(cache_entry);
+  for (int i = 0; result == 0 && i < count; i++) {
+    const ar_index *index = pending[i].index;
+    size_t members_size = index->symbol_count * sizeof(uint32_t);
+    if (write_padding(file, &offset, entries[i].symbol_members) == -1 ||
+        fwrite(index->symbol_members, 1, members_size, file) != members_size ||
+        fwrite(index->path, 1, index->path_len + 1, file) !=
+            index->path_len + 1 ||
+        fwrite(index->names, 1, index->names_len, file) != index->names_len ||
+        fwrite(index->symbols, 1, index->symbols_len, file) !=
+            index->symbols_len)
+      result = -1;
+    offset += members_size + index->path_len + 1 + index->names_len +
+              index->symbols_len;
+  }
+  free(entries);
+  return result;
+}
+
+int ar_cache_write(const ar_cache *old, const ar_index *fresh, int count,
+                   const char *path) {
+  ar_index *kept = calloc(old->count ? old->count : 1, sizeof(ar_index));
+  pending_entry *pending =
+      calloc((size_t)count + old->count + 1, sizeof(pending_entry));
+  char *temp = malloc(strlen(path) + 32);
+  if (kept == NULL || pending == NULL || temp == NULL) {
+    perror("malloc() failed");
+    free(kept);
+    free(pending);
+    free(temp);
+    return -1;
+  }
+
+  int total = 0;
+  for (int i = 0; i < count; i++, total++)
+    pending[total] = (pending_entry){&fresh[i], total};
+  // Old entries survive only while their archive is unchanged.
+  for (uint32_t i = 0; i < old->count; i++) {
+    struct stat st;
+    if (load_entry(old, entry_at(old, i), &kept[i]) == 0 &&
+        stat(kept[i].path, &st) == 0 && ar_index_current(&kept[i], &st)) {
+      pending[total] = (pending_entry){&kept[i], total};
+      total++;
+    }
+  }
+  qsort(pending, total, sizeof(pending_entry), compare_pending);
+  int unique = 0;
+  for (int i = 0; i < total; i++)
+    if (unique == 0 ||
+        compare_path(pending[unique - 1].index->path,
+                     pending[unique - 1].index->path_len,
+                     pending[i].index->path, pending[i].index->path_len) != 0)
+      pending[unique++] = pending[i];
+
+  sprintf(temp, "%s.%ld.tmp", path, (long)getpid());
+  FILE *file = fopen(temp, "w");
+  int result = -1;
+  if (file == NULL) {
+    perror(temp);
+  } else {
+    result = write_entries(file, pending, unique);
+    if (fclose(file) != 0)
+      result = -1;
+    if (result == 0 && rename(temp, path) == -1)
+      result = -1;
+    if (result == -1) {
+      perror(path);
+      unlink(temp);
+    }
+  }
+  free(kept);
+  free(pending);
+  free(temp);
+  return result;
+}
+
+void ar_cache_close(ar_cache *cache) {
+  if (cache->data != NULL)
+    munmap((void *)cache->data, cache->size);
+  memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,69 @@
+#ifndef ARCACHE_H
+#define ARCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// The index also holds the archive symbol table.
+#define AR_INDEX_SYMBOLS 1
+// Symbol table entry that does not point at a member.
+#define AR_INDEX_NO_MEMBER UINT32_MAX
+
+// Everything a query needs to know about one version of an archive. Indexes
+// returned by ar_cache_lookup() point into the cache mapping, the ones built
+// by ar_index_build() own their memory.
+typedef struct {
+  const char *path; // NUL-terminated, the cache key
+  size_t path_len;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint32_t flags;
+  const char *names; // member names, each followed by '\n'
+  size_t names_len;
+  uint32_t member_count;
+  const char *symbols; // symbol names, each followed by '\n'
+  size_t symbols_len;
+  const uint32_t *symbol_members; // defining member of every symbol
+  uint32_t symbol_count;
+} ar_index;
+
+// Scans the archive and builds an index for it under the given key, stamped
+// with the size and modification time in st. flags selects the optional
+// parts. Returns -1 with a diagnostic on stderr on failure.
+int ar_index_build(const char *archive, const char *key, const struct stat *st,
+                   uint32_t flags, ar_index *index);
+
+// Returns non-zero if the index describes the file version st refers to.
+int ar_index_current(const ar_index *index, const struct stat *st);
+
+void ar_index_free(ar_index *index);
+
+// A read-only mapping of the cache file: a header, a table of fixed-size
+// entries sorted by path and the data they point to. Lookups are a binary
+// search over the mapping and copy nothing.
+typedef struct {
+  const char *data;
+  size_t size;
+  uint32_t count;
+} ar_cache;
+
+// Maps the cache file. A missing file gives an empty cache, a file that is
+// not a valid cache is reported and ignored. Returns 0.
+int ar_cache_open(ar_cache *cache, const char *path);
+
+// Finds the entry stored for path. Returns 0 and fills index if there is one,
+// whether or not it is still current, and -1 otherwise.
+int ar_cache_lookup(const ar_cache *cache, const char *path, ar_index *index);
+
+// Replaces the cache file with the fresh indexes and those entries of the old
+// cache that are still current; entries of archives that changed or vanished
+// are dropped. The file is written beside path and renamed over it, so
+// readers see either the old or the new cache. Returns -1 on failure.
+int ar_cache_write(const ar_cache *old, const ar_index *fresh, int count,
+                   const char *path);
+
+void ar_cache_close(ar_cache *cache);
+
+#endif
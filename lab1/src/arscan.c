@@ -0,0 +1,387 @@
+#include "arscan.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AR_MAGIC "!<arch>\n"
+#define AR_THIN_MAGIC "!<thin>\n"
+#define AR_MAGIC_LEN 8
+#define AR_HDR_LEN 60
+#define AR_NAME_LEN 16
+
+// Layout of a member header, all fields are space-padded ASCII.
+struct ar_hdr {
+  char name[AR_NAME_LEN];
+  char date[12];
+  char uid[6];
+  char gid[6];
+  char mode[8];
+  char size[10];
+  char fmag[2];
+};
+
+static int parse_decimal(const char *field, size_t len, size_t *value) {
+  size_t i = 0, result = 0;
+  while (i < len && field[i] == ' ')
+    i++;
+  if (i == len || field[i] < '0' || field[i] > '9')
+    return -1;
+  for (; i < len && field[i] >= '0' && field[i] <= '9'; i++)
+    result = result * 10 + (size_t)(field[i] - '0');
+  for (; i < len; i++)
+    if (field[i] != ' ')
+      return -1;
+  *value = result;
+  return 0;
+}
+
+static int is_bsd_symdef(const char *name, size_t len) {
+  return len >= 9 && memcmp(name, "__.SYMDEF", 9) == 0;
+}
+
+// Kinds of archive symbol table.
+enum { SYMTAB_NONE, SYMTAB_GNU32, SYMTAB_GNU64, SYMTAB_BSD32, SYMTAB_BSD64 };
+
+typedef struct {
+  int kind;
+  const char *data;
+  size_t size;
+} ar_symtab;
+
+// Called with the header offset of every regular member.
+typedef int (*walk_fn)(const char *name, size_t len, size_t offset, void *ctx);
+
+// Walks the member headers and locates the symbol table. Returns 0 on success
+// and -1 if the data is not an archive or is truncated.
+static int walk_archive(const char *data, size_t size, walk_fn fn, void *ctx,
+                        ar_symtab *symtab) {
+  if (size < AR_MAGIC_LEN)
+    return -1;
+  int thin = memcmp(data, AR_THIN_MAGIC, AR_MAGIC_LEN) == 0;
+  if (!thin && memcmp(data, AR_MAGIC, AR_MAGIC_LEN) != 0)
+    return -1;
+
+  const char *long_names = NULL;
+  size_t long_names_size = 0;
+  size_t pos = AR_MAGIC_LEN;
+  symtab->kind = SYMTAB_NONE;
+
+  while (pos < size) {
+    if (size - pos < AR_HDR_LEN)
+      return -1;
+    const struct ar_hdr *hdr = (const struct ar_hdr *)(data + pos);
+    size_t member_size, header = pos;
+    if (memcmp(hdr->fmag, "`\n", 2) != 0 ||
+        parse_decimal(hdr->size, sizeof(hdr->size), &member_size) == -1)
+      return -1;
+    pos += AR_HDR_LEN;
+
+    const char *name = hdr->name;
+    size_t name_len = AR_NAME_LEN, skip = 0;
+    // Symbol tables and the long-name table are stored even in thin archives,
+    // regular members of thin archives only have a header.
+    int has_data = !thin, table = SYMTAB_NONE;
+
+    if (name[0] == '/' && (name[1] == ' ' || memcmp(name, "/SYM64/", 7) == 0)) {
+      table = name[1] == ' ' ? SYMTAB_GNU32 : SYMTAB_GNU64;
+      name = NULL;
+      has_data = 1;
+    } else if (name[0] == '/' && name[1] == '/') {
+      if (member_size > size - pos)
+        return -1;
+      long_names = data + pos;
+      long_names_size = member_size;
+      name = NULL;
+      has_data = 1;
+    } else if (name[0] == '/') {
+      size_t offset;
+      if (long_names == NULL ||
+          parse_decimal(name + 1, AR_NAME_LEN - 1, &offset) == -1 ||
+          offset >= long_names_size)
+        return -1;
+      name = long_names + offset;
+      name_len = 0;
+      while (offset + name_len < long_names_size && name[name_len] != '\n')
+        name_len++;
+      if (name_len > 0 && name[name_len - 1] == '/')
+        name_len--;
+    } else if (memcmp(name, "#1/", 3) == 0) {
+      size_t bsd_len;
+      if (parse_decimal(name + 3, AR_NAME_LEN - 3, &bsd_len) == -1 ||
+          bsd_len > member_size || bsd_len > size - pos)
+        return -1;
+      name = data + pos;
+      name_len = skip = bsd_len;
+      while (name_len > 0 && name[name_len - 1] == '\0')
+        name_len--;
+    } else {
+      while (name_len > 0 && name[name_len - 1] == ' ')
+        name_len--;
+      if (name_len > 0 && name[name_len - 1] == '/')
+        name_len--;
+    }
+    if (name != NULL && is_bsd_symdef(name, name_len)) {
+      table = name_len >= 12 && memcmp(name + 9, "_64", 3) == 0
+                  ? SYMTAB_BSD64
+                  : SYMTAB_BSD32;
+      name = NULL;
+      has_data = 1;
+    }
+
+    if (table != SYMTAB_NONE && symtab->kind == SYMTAB_NONE &&
+        member_size <= size - pos) {
+      symtab->kind = table;
+      symtab->data = data + pos + skip;
+      symtab->size = member_size - skip;
+    }
+
+    if (name != NULL && fn(name, name_len, header, ctx) != 0)
+      return 0;
+
+    if (has_data) {
+      if (member_size > size - pos)
+        return -1;
+      pos += member_size + (member_size & 1);
+    }
+  }
+  return 0;
+}
+
+typedef struct {
+  ar_member_fn fn;
+  void *ctx;
+} member_adapter;
+
+static int report_member(const char *name, size_t len, size_t offset,
+                         void *ctx) {
+  member_adapter *adapter = ctx;
+  (void)offset;
+  return adapter->fn(name, len, adapter->ctx);
+}
+
+int ar_scan_buffer(const char *data, size_t size, ar_member_fn fn, void *ctx) {
+  member_adapter adapter = {fn, ctx};
+  ar_symtab symtab;
+  return walk_archive(data, size, report_member, &adapter, &symtab);
+}
+
+typedef struct {
+  size_t *offsets;
+  size_t count;
+  size_t capacity;
+} offset_list;
+
+static int collect_offset(const char *name, size_t len, size_t offset,
+                          void *ctx) {
+  offset_list *list = ctx;
+  (void)name;
+  (void)len;
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 64;
+    size_t *resized = realloc(list->offsets, capacity * sizeof(size_t));
+    if (resized == NULL)
+      return 1;
+    list->offsets = resized;
+    list->capacity = capacity;
+  }
+  list->offsets[list->count++] = offset;
+  return 0;
+}
+
+static uint64_t read_word(const unsigned char *p, int width, int big_endian) {
+  uint64_t value = 0;
+  if (!big_endian) {
+    if (width == 4) {
+      uint32_t word;
+      memcpy(&word, p, 4);
+      return word;
+    }
+    memcpy(&value, p, 8);
+    return value;
+  }
+  for (int i = 0; i < width; i++)
+    value = value << 8 | p[i];
+  return value;
+}
+
+// Member headers are visited in file order, so the offsets are sorted.
+static int find_member(const offset_list *list, uint64_t offset) {
+  size_t lo = 0, hi = list->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (list->offsets[mid] < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < list->count && list->offsets[lo] == offset ? (int)lo : -1;
+}
+
+int ar_scan_symbols(const char *data, size_t size, ar_symbol_fn fn,
+                    void *ctx) {
+  offset_list list = {NULL, 0, 0};
+  ar_symtab symtab;
+  if (walk_archive(data, size, collect_offset, &list, &symtab) == -1) {
+    free(list.offsets);
+    return -1;
+  }
+
+  const unsigned char *table = (const unsigned char *)symtab.data;
+  size_t table_size = symtab.size, count = 0, width = 4;
+  const unsigned char *offsets = NULL, *strings = NULL, *strings_end = NULL;
+  int gnu = symtab.kind == SYMTAB_GNU32 || symtab.kind == SYMTAB_GNU64;
+  int result = 0;
+  if (symtab.kind == SYMTAB_GNU64 || symtab.kind == SYMTAB_BSD64)
+    width = 8;
+
+  if (gnu && table_size >= width) {
+    // GNU: big-endian count, member offsets, then NUL-terminated names.
+    count = read_word(table, width, 1);
+    if (count <= (table_size - width) / width) {
+      offsets = table + width;
+      strings = offsets + count * width;
+      strings_end = table + table_size;
+    } else {
+      result = -1;
+    }
+  } else if (symtab.kind != SYMTAB_NONE && table_size >= 2 * width) {
+    // BSD: byte size of the (name index, member offset) pairs, the pairs,
+    // byte size of the string table, the string table.
+    uint64_t ranlib_size = read_word(table, width, 0);
+    if (ranlib_size <= table_size - 2 * width) {
+      count = ranlib_size / (2 * width);
+      offsets = table + width;
+      uint64_t strings_size = read_word(offsets + ranlib_size, width, 0);
+      strings = offsets + ranlib_size + width;
+      if (strings_size > table_size - 2 * width - ranlib_size)
+        result = -1;
+      strings_end = strings + strings_size;
+    } else {
+      result = -1;
+    }
+  }
+
+  const unsigned char *name = strings;
+  for (size_t i = 0; result == 0 && i < count; i++) {
+    uint64_t offset;
+    if (gnu) {
+      offset = read_word(offsets + i * width, width, 1);
+    } else {
+      uint64_t index = read_word(offsets + 2 * i * width, width, 0);
+      offset = read_word(offsets + (2 * i + 1) * width, width, 0);
+      if (index >= (size_t)(strings_end - strings)) {
+        result = -1;
+        break;
+      }
+      name = strings + index;
+    }
+    const unsigned char *end = memchr(name, '\0', strings_end - name);
+    if (end == NULL) {
+      result = -1;
+      break;
+    }
+    if (fn((const char *)name, end - name, find_member(&list, offset), ctx))
+      break;
+    name = end + 1;
+  }
+  free(list.offsets);
+  return result;
+}
+
+int ar_scan_file(const char *path, ar_member_fn fn, ar_symbol_fn symbol_fn,
+                 void *ctx) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "ar: %s: No such file or directory\n", path);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+    fprintf(stderr, "ar: %s: file format not recognized\n", path);
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    fprintf(stderr, "ar: %s: file format not recognized\n", path);
+    close(fd);
+    return -1;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("mmap() failed");
+    return -1;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  int result = ar_scan_buffer(data, st.st_size, fn, ctx);
+  if (result == 0 && symbol_fn != NULL)
+    result = ar_scan_symbols(data, st.st_size, symbol_fn, ctx);
+  munmap(data, st.st_size);
+  if (result == -1)
+    fprintf(stderr, "ar: %s: file format not recognized\n", path);
+  return result;
+}
+
+int ar_pattern_compile(ar_pattern *pat, const char *pattern) {
+  int count = 1;
+  for (const char *p = pattern; *p; p++)
+    if (*p == '\n')
+      count++;
+  pat->regs = calloc(count, sizeof(regex_t));
+  pat->count = 0;
+  if (pat->regs == NULL)
+    return -1;
+
+  const char *start = pattern;
+  for (int i = 0; i < count; i++) {
+    const char *end = strchr(start, '\n');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+    char *line = strndup(start, len);
+    int err = line ? regcomp(&pat->regs[i], line, REG_NOSUB) : REG_ESPACE;
+    free(line);
+    if (err != 0) {
+      char msg[256];
+      regerror(err, &pat->regs[i], msg, sizeof(msg));
+      fprintf(stderr, "grep: %s\n", msg);
+      ar_pattern_free(pat);
+      return -1;
+    }
+    pat->count++;
+    start = end ? end + 1 : start + len;
+  }
+  return 0;
+}
+
+int ar_pattern_match(const ar_pattern *pat, const char *name, size_t len) {
+#ifdef REG_STARTEND
+  regmatch_t range;
+  for (int i = 0; i < pat->count; i++) {
+    range.rm_so = 0;
+    range.rm_eo = (regoff_t)len;
+    if (regexec(&pat->regs[i], name, 1, &range, REG_STARTEND) == 0)
+      return 1;
+  }
+  return 0;
+#else
+  char *copy = strndup(name, len);
+  int matched = 0;
+  for (int i = 0; copy && !matched && i < pat->count; i++)
+    matched = regexec(&pat->regs[i], copy, 0, NULL, 0) == 0;
+  free(copy);
+  return matched;
+#endif
+}
+
+void ar_pattern_free(ar_pattern *pat) {
+  for (int i = 0; i < pat->count; i++)
+    regfree(&pat->regs[i]);
+  free(pat->regs);
+  pat->regs = NULL;
+  pat->count = 0;
+}
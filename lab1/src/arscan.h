@@ -0,0 +1,50 @@
+#ifndef ARSCAN_H
+#define ARSCAN_H
+
+#include <regex.h>
+#include <stddef.h>
+
+// Called for every regular member of an archive, in archive order. The name
+// is not NUL-terminated. A non-zero return value stops the scan.
+typedef int (*ar_member_fn)(const char *name, size_t len, void *ctx);
+
+// Walks the member headers of a GNU/SysV, BSD or thin archive mapped in
+// memory and reports the names `ar -t` would list: symbol tables and the GNU
+// long-name table are skipped, long names are resolved. Returns 0 on success
+// and -1 if the data is not an archive or is truncated.
+int ar_scan_buffer(const char *data, size_t size, ar_member_fn fn, void *ctx);
+
+// Called for every entry of the archive symbol table. member is the index of
+// the defining member in the order ar_member_fn sees them, or -1 if the entry
+// does not point at a member header. The symbol is not NUL-terminated.
+typedef int (*ar_symbol_fn)(const char *symbol, size_t len, int member,
+                            void *ctx);
+
+// Decodes the archive symbol table: the GNU "/" and "/SYM64/" members or the
+// BSD "__.SYMDEF" ones. An archive without a symbol table has no entries.
+// Returns 0 on success and -1 if the archive or its symbol table is malformed.
+int ar_scan_symbols(const char *data, size_t size, ar_symbol_fn fn, void *ctx);
+
+// Maps the archive at path and scans it with ar_scan_buffer() and, unless
+// symbol_fn is NULL, ar_scan_symbols(). Prints a diagnostic to stderr and
+// returns -1 on failure.
+int ar_scan_file(const char *path, ar_member_fn fn, ar_symbol_fn symbol_fn,
+                 void *ctx);
+
+// A grep-style pattern list: like `grep -e`, a pattern containing newlines
+// matches a name if any of its lines does.
+typedef struct {
+  regex_t *regs;
+  int count;
+} ar_pattern;
+
+// Compiles pattern as POSIX basic regular expressions. Returns 0 on success
+// and -1 with a diagnostic on stderr otherwise.
+int ar_pattern_compile(ar_pattern *pat, const char *pattern);
+
+// Returns non-zero if the name matches any of the compiled expressions.
+int ar_pattern_match(const ar_pattern *pat, const char *name, size_t len);
+
+void ar_pattern_free(ar_pattern *pat);
+
+#endif
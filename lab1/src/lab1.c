@@ -1,48 +1,461 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-void pipe_exec(char *cmd[], int input_fd, int output_fd) {
-  if (fork() == 0) {
-    if (input_fd != STDIN_FILENO) {
-      dup2(input_fd, STDIN_FILENO);
-      close(input_fd);
+#include "arcache.h"
+#include "arscan.h"
+#include "pipeline.h"
+
+// One archive to query and the output collected for it.
+typedef struct {
+  char *path;
+  char *output;
+  size_t size;
+  int failed;
+  int done;
+  ar_index index; // built by this run, to be stored in the cache
+  int indexed;
+  char *report; // per-stage throughput of the pipeline
+  size_t report_size;
+} scan_job;
+
+// Work queue shared by the worker threads. Workers take the next job index,
+// the main thread prints finished jobs in input order.
+typedef struct {
+  scan_job *jobs;
+  int count;
+  int next;
+  const char *pattern;
+  const char *chain;
+  int report;
+  int native;
+  int symbols;
+  const ar_cache *cache;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+} scan_queue;
+
+// Prints a member name if it matches the pattern, as grep would print the
+// corresponding line of `ar -t`.
+int print_match(const char *name, size_t len, void *ctx) {
+  void **args = ctx;
+  if (ar_pattern_match(args[0], name, len)) {
+    fwrite(name, 1, len, args[1]);
+    fputc('\n', args[1]);
+  }
+  return 0;
+}
+
+// Answers the query in-process: the archive is mapped and its headers are
+// walked directly instead of running `ar -t | grep -e`.
+int native_query(const char *archive, const ar_pattern *pat, FILE *out) {
+  void *args[] = {(void *)pat, out};
+  return ar_scan_file(archive, print_match, NULL, args) == -1 ? 1 : 0;
+}
+
+// Returns a copy of word with every "{}" replaced by path.
+char *substitute(const char *word, const char *path) {
+  size_t len = strlen(word) + 1;
+  for (const char *p = strstr(word, "{}"); p; p = strstr(p + 2, "{}"))
+    len += strlen(path);
+  char *result = malloc(len), *end = result;
+  if (result == NULL)
+    return NULL;
+  for (const char *p = word; *p;) {
+    if (p[0] == '{' && p[1] == '}') {
+      end = stpcpy(end, path);
+      p += 2;
+    } else {
+      *end++ = *p++;
+    }
+  }
+  *end = '\0';
+  return result;
+}
+
+// Builds the stages for one archive: `ar -t archive | grep -e pattern`, or
+// the chain given with -x with {} replaced by the archive.
+int build_stages(const scan_job *job, const scan_queue *queue,
+                 pipeline_stage **stages) {
+  if (queue->chain != NULL) {
+    int count = pipeline_parse(queue->chain, -1, stages);
+    for (int i = 0; i < count; i++)
+      for (int j = 0; (*stages)[i].argv[j]; j++) {
+        char *word = substitute((*stages)[i].argv[j], job->path);
+        if (word == NULL) {
+          pipeline_free(*stages, count);
+          return -1;
+        }
+        free((*stages)[i].argv[j]);
+        (*stages)[i].argv[j] = word;
+      }
+    return count;
+  }
+
+  int count = pipeline_parse("ar -t {} | grep -e {}", -1, stages);
+  if (count != 2)
+    return -1;
+  free((*stages)[0].argv[2]);
+  free((*stages)[1].argv[2]);
+  (*stages)[0].argv[2] = strdup(job->path);
+  (*stages)[1].argv[2] = strdup(queue->pattern);
+  if ((*stages)[0].argv[2] == NULL || (*stages)[1].argv[2] == NULL) {
+    pipeline_free(*stages, count);
+    return -1;
+  }
+  return count;
+}
+
+// Runs the pipeline of one archive. Every final stage writes into its own
+// memory file, their outputs are collected in stage order. The job fails if
+// the first stage fails, as `ar` does for a missing or broken archive.
+int pipeline_job(scan_job *job, const scan_queue *queue, FILE *out) {
+  pipeline_stage *stages;
+  int count = build_stages(job, queue, &stages);
+  if (count == -1)
+    return 1;
+
+  int failed = 0;
+  for (int i = 0; i < count; i++) {
+    int final = 1;
+    for (int j = i + 1; j < count; j++)
+      final &= stages[j].parent != i;
+    stages[i].output = final ? memfd_create("lab1", MFD_CLOEXEC) : -1;
+    if (final && stages[i].output == -1) {
+      perror("memfd_create() failed");
+      failed = 1;
     }
-    if (output_fd != STDOUT_FILENO) {
-      dup2(output_fd, STDOUT_FILENO);
-      close(output_fd);
+  }
+
+  if (!failed)
+    failed = pipeline_run(stages, count, STDIN_FILENO, PIPELINE_PIPE_SIZE) ==
+                 -1 ||
+             stages[0].status != 0;
+  for (int i = 0; i < count; i++) {
+    if (stages[i].output == -1)
+      continue;
+    char buffer[4096];
+    ssize_t n;
+    lseek(stages[i].output, 0, SEEK_SET);
+    while ((n = read(stages[i].output, buffer, sizeof(buffer))) > 0)
+      fwrite(buffer, 1, n, out);
+    close(stages[i].output);
+  }
+
+  FILE *report;
+  if (queue->report &&
+      (report = open_memstream(&job->report, &job->report_size)) != NULL) {
+    pipeline_report(stages, count, report);
+    fclose(report);
+  }
+  pipeline_free(stages, count);
+  return failed;
+}
+
+// Prints the members, or with symbols the symbol table entries, of an index
+// that match the pattern.
+void index_query(const ar_index *index, const ar_pattern *pat, int symbols,
+                 FILE *out) {
+  const char *line = symbols ? index->symbols : index->names;
+  const char *end = line + (symbols ? index->symbols_len : index->names_len);
+  const char *names_end = index->names + index->names_len;
+  const char **members = NULL;
+  if (symbols && index->member_count > 0) {
+    members = malloc(index->member_count * sizeof(char *));
+    const char *name = index->names;
+    for (uint32_t i = 0; members && i < index->member_count; i++) {
+      members[i] = name;
+      const char *eol = memchr(name, '\n', names_end - name);
+      name = eol ? eol + 1 : names_end;
+    }
+  }
+
+  for (uint32_t i = 0; line < end; i++) {
+    const char *eol = memchr(line, '\n', end - line);
+    size_t len = eol ? (size_t)(eol - line) : (size_t)(end - line);
+    if (ar_pattern_match(pat, line, len)) {
+      fwrite(line, 1, len, out);
+      uint32_t member =
+          symbols && i < index->symbol_count ? index->symbol_members[i]
+                                             : AR_INDEX_NO_MEMBER;
+      if (members != NULL && member < index->member_count) {
+        const char *name = members[member];
+        const char *name_end = memchr(name, '\n', names_end - name);
+        fputs(" in ", out);
+        fwrite(name, 1, (name_end ? name_end : names_end) - name, out);
+      }
+      fputc('\n', out);
     }
-    execvp(cmd[0], cmd);
-    fprintf(stderr, "Error starting %s\n", cmd[0]);
-    exit(EXIT_FAILURE);
+    line += len + 1;
   }
+  free(members);
 }
 
-int main(int argc, char *argv[]) {
-  if (argc != 3) {
-    fprintf(stderr, "Usage: %s <archive> \"<pattern>\"\n", argv[0]);
+// Answers the query from the cache if it holds a current index of the
+// archive, otherwise indexes the archive and keeps the index for the cache.
+int indexed_query(scan_job *job, const scan_queue *queue,
+                  const ar_pattern *pat, FILE *out) {
+  struct stat st;
+  if (stat(job->path, &st) == -1) {
+    fprintf(stderr, "ar: %s: No such file or directory\n", job->path);
+    return 1;
+  }
+  char *key = realpath(job->path, NULL);
+  uint32_t flags = queue->symbols ? AR_INDEX_SYMBOLS : 0;
+  ar_index cached;
+  if (queue->cache != NULL &&
+      ar_cache_lookup(queue->cache, key ? key : job->path, &cached) == 0 &&
+      ar_index_current(&cached, &st) && (cached.flags & flags) == flags) {
+    free(key);
+    index_query(&cached, pat, queue->symbols, out);
+    return 0;
+  }
+
+  int result =
+      ar_index_build(job->path, key ? key : job->path, &st, flags, &job->index);
+  free(key);
+  if (result == -1)
     return 1;
+  index_query(&job->index, pat, queue->symbols, out);
+  // An archive rewritten while it was being read must not be cached under
+  // the old size and time.
+  job->indexed =
+      stat(job->path, &st) == 0 && ar_index_current(&job->index, &st);
+  return 0;
+}
+
+void *scan_worker(void *arg) {
+  scan_queue *queue = arg;
+  ar_pattern pat;
+  // Every worker compiles its own pattern: regexec() serializes callers that
+  // share a compiled expression.
+  if (queue->native && ar_pattern_compile(&pat, queue->pattern) == -1)
+    pat.count = -1;
+
+  while (1) {
+    pthread_mutex_lock(&queue->lock);
+    int index = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (index >= queue->count)
+      break;
+
+    scan_job *job = &queue->jobs[index];
+    FILE *out = open_memstream(&job->output, &job->size);
+    if (out == NULL)
+      job->failed = 1;
+    else if (queue->native && pat.count == -1)
+      job->failed = 1;
+    else if (queue->cache != NULL || queue->symbols)
+      job->failed = indexed_query(job, queue, &pat, out);
+    else if (queue->native)
+      job->failed = native_query(job->path, &pat, out);
+    else
+      job->failed = pipeline_job(job, queue, out);
+    if (out != NULL)
+      fclose(out);
+
+    pthread_mutex_lock(&queue->lock);
+    job->done = 1;
+    pthread_cond_broadcast(&queue->done);
+    pthread_mutex_unlock(&queue->lock);
+  }
+
+  if (queue->native && pat.count != -1)
+    ar_pattern_free(&pat);
+  return NULL;
+}
+
+int add_job(scan_job **jobs, int *count, int *capacity, const char *path) {
+  if (*count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 16;
+    scan_job *resized = realloc(*jobs, *capacity * sizeof(scan_job));
+    if (resized == NULL)
+      return -1;
+    *jobs = resized;
+  }
+  scan_job *job = &(*jobs)[(*count)++];
+  memset(job, 0, sizeof(*job));
+  job->path = strdup(path);
+  return job->path ? 0 : -1;
+}
+
+int is_archive_name(const char *name) {
+  size_t len = strlen(name);
+  return len > 2 && strcmp(name + len - 2, ".a") == 0;
+}
+
+// Adds every *.a file below dir, visiting entries in sorted order so the
+// output does not depend on directory layout on disk.
+int collect_dir(const char *dir, scan_job **jobs, int *count, int *capacity) {
+  struct dirent **entries;
+  int n = scandir(dir, &entries, NULL, alphasort);
+  if (n == -1) {
+    perror(dir);
+    return -1;
+  }
+  int result = 0;
+  for (int i = 0; i < n; i++) {
+    const char *name = entries[i]->d_name;
+    if (result == 0 && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+      char *path = malloc(strlen(dir) + strlen(name) + 2);
+      struct stat st;
+      if (path == NULL) {
+        result = -1;
+      } else {
+        sprintf(path, "%s/%s", dir, name);
+        if (lstat(path, &st) == 0) {
+          if (S_ISDIR(st.st_mode))
+            result = collect_dir(path, jobs, count, capacity);
+          else if (S_ISREG(st.st_mode) && is_archive_name(name))
+            result = add_job(jobs, count, capacity, path);
+        }
+        free(path);
+      }
+    }
+    free(entries[i]);
   }
+  free(entries);
+  return result;
+}
 
-  int pipe1[2];
+void print_job(const scan_job *job, int tag) {
+  if (!tag) {
+    fwrite(job->output, 1, job->size, stdout);
+    return;
+  }
+  const char *line = job->output, *end = job->output + job->size;
+  while (line < end) {
+    const char *eol = memchr(line, '\n', end - line);
+    size_t len = eol ? (size_t)(eol - line) + 1 : (size_t)(end - line);
+    printf("%s:", job->path);
+    fwrite(line, 1, len, stdout);
+    line += len;
+  }
+}
 
-  if (pipe(pipe1) == -1) {
-    perror("pipe() failed");
-    exit(EXIT_FAILURE);
+int main(int argc, char *argv[]) {
+  int native = 0, symbols = 0, report = 0, tag = -1;
+  const char *cache_path = NULL, *chain = NULL;
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+  while ((opt = getopt(argc, argv, "nsc:x:tj:Hh")) != -1) {
+    if (opt == 'n')
+      native = 1;
+    else if (opt == 's')
+      native = symbols = 1;
+    else if (opt == 'c')
+      native = 1, cache_path = optarg;
+    else if (opt == 'x')
+      chain = optarg;
+    else if (opt == 't')
+      report = 1;
+    else if (opt == 'j')
+      workers = atol(optarg);
+    else if (opt == 'H')
+      tag = 1;
+    else if (opt == 'h')
+      tag = 0;
+    else
+      argc = 0;
+  }
+  if (argc - optind < (chain ? 1 : 2) || workers < 1 || (chain && native)) {
+    fprintf(stderr,
+            "Usage: %s [-n] [-s] [-c cache] [-t] [-j jobs] [-H|-h] "
+            "<archive|dir>... \"<pattern>\"\n"
+            "       %s -x \"<command> | <command>[, <command>]...\" [-t] "
+            "[-j jobs] [-H|-h] <archive|dir>...\n",
+            argv[0], argv[0]);
+    return 1;
   }
+  const char *pattern = chain ? NULL : argv[argc - 1];
 
-  char *ar_cmd[] = {"ar", "-t", argv[1], NULL};
-  char *grep_cmd[] = {"grep", "-e", argv[2], NULL};
+  scan_job *jobs = NULL;
+  int count = 0, capacity = 0, failed = 0;
+  for (int i = optind; i < (chain ? argc : argc - 1); i++) {
+    struct stat st;
+    if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+      if (collect_dir(argv[i], &jobs, &count, &capacity) == -1)
+        failed = 1;
+    } else if (add_job(&jobs, &count, &capacity, argv[i]) == -1) {
+      perror("malloc() failed");
+      return 1;
+    }
+  }
+  if (tag == -1)
+    tag = count > 1;
+  if (native)
+    setlocale(LC_ALL, "");
 
-  pipe_exec(ar_cmd, STDIN_FILENO, pipe1[1]);
-  close(pipe1[1]);
+  ar_cache cache;
+  if (cache_path != NULL)
+    ar_cache_open(&cache, cache_path);
 
-  pipe_exec(grep_cmd, pipe1[0], STDOUT_FILENO);
-  close(pipe1[0]);
+  scan_queue queue = {.jobs = jobs,
+                      .count = count,
+                      .next = 0,
+                      .pattern = pattern,
+                      .chain = chain,
+                      .report = report,
+                      .native = native,
+                      .symbols = symbols,
+                      .cache = cache_path ? &cache : NULL};
+  pthread_mutex_init(&queue.lock, NULL);
+  pthread_cond_init(&queue.done, NULL);
 
-  while (wait(NULL) > 0)
-    ;
+  if (workers > count)
+    workers = count;
+  pthread_t *threads = calloc(workers > 0 ? workers : 1, sizeof(pthread_t));
+  for (long i = 0; i < workers; i++)
+    pthread_create(&threads[i], NULL, scan_worker, &queue);
 
-  return 0;
+  for (int i = 0; i < count; i++) {
+    pthread_mutex_lock(&queue.lock);
+    while (!jobs[i].done)
+      pthread_cond_wait(&queue.done, &queue.lock);
+    pthread_mutex_unlock(&queue.lock);
+    print_job(&jobs[i], tag);
+    fflush(stdout);
+    if (jobs[i].report != NULL) {
+      if (tag)
+        fprintf(stderr, "%s:\n", jobs[i].path);
+      fwrite(jobs[i].report, 1, jobs[i].report_size, stderr);
+      free(jobs[i].report);
+    }
+    failed |= jobs[i].failed;
+    free(jobs[i].output);
+  }
+
+  for (long i = 0; i < workers; i++)
+    pthread_join(threads[i], NULL);
+
+  // Only archives indexed by this run change the cache.
+  if (cache_path != NULL) {
+    ar_index *fresh = calloc(count ? count : 1, sizeof(ar_index));
+    int indexed = 0;
+    for (int i = 0; fresh && i < count; i++)
+      if (jobs[i].indexed)
+        fresh[indexed++] = jobs[i].index;
+    if (indexed > 0)
+      ar_cache_write(&cache, fresh, indexed, cache_path);
+    free(fresh);
+    ar_cache_close(&cache);
+  }
+  for (int i = 0; i < count; i++) {
+    ar_index_free(&jobs[i].index);
+    free(jobs[i].path);
+  }
+  pthread_mutex_destroy(&queue.lock);
+  pthread_cond_destroy(&queue.done);
+  free(threads);
+  free(jobs);
+  return failed;
 }
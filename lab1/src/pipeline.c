@@ -0,0 +1,565 @@
+#define _GNU_SOURCE
+#include "pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MOVE_FLAGS (SPLICE_F_MOVE | SPLICE_F_NONBLOCK)
+
+extern char **environ;
+
+// Where part of the output of a stage goes: the input pipe of a stage that
+// reads it, or the pipeline output. When several stages read the same
+// output, every one of them is fed from its own staging pipe.
+typedef struct {
+  int fd;
+  int stage; // reading stage, -1 for the pipeline output
+  int staging[2];
+  size_t staged;
+  int blocked; // the destination was full, wait until it is writable
+  int closed;
+} relay_link;
+
+typedef struct {
+  int out;   // read end of the stage's standard output
+  int input; // read end of its standard input, closed once it is started
+  relay_link *links;
+  int link_count;
+  int copy; // the output does not support splice(), copy through a buffer
+  double start;
+} relay;
+
+pid_t pipe_exec(char *cmd[], int input_fd, int output_fd) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t signals;
+  posix_spawn_file_actions_init(&actions);
+  if (input_fd != STDIN_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, input_fd, STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, input_fd);
+  }
+  if (output_fd != STDOUT_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, output_fd);
+  }
+  // The runner blocks SIGPIPE while it relays data, commands start with the
+  // usual disposition and an empty mask as under a shell.
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr,
+                          POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigaddset(&signals, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+
+  pid_t pid;
+  int err = posix_spawnp(&pid, cmd[0], &actions, &attr, cmd, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (err != 0) {
+    fprintf(stderr, "Error starting %s\n", cmd[0]);
+    return -1;
+  }
+  return pid;
+}
+
+static int add_word(char ***argv, int *argc, const char *word, size_t len) {
+  char **resized = realloc(*argv, (*argc + 2) * sizeof(char *));
+  if (resized == NULL)
+    return -1;
+  *argv = resized;
+  if ((resized[*argc] = strndup(word, len)) == NULL)
+    return -1;
+  resized[++*argc] = NULL;
+  return 0;
+}
+
+static int add_stage(pipeline_stage **stages, int *count, char **argv,
+                     int parent, int output) {
+  pipeline_stage *resized = realloc(*stages, (*count + 1) * sizeof(**stages));
+  if (resized == NULL)
+    return -1;
+  *stages = resized;
+  memset(&resized[*count], 0, sizeof(**stages));
+  resized[*count].argv = argv;
+  resized[*count].parent = parent;
+  resized[*count].output = output;
+  (*count)++;
+  return 0;
+}
+
+int pipeline_parse(const char *spec, int output, pipeline_stage **stages) {
+  char *word = malloc(strlen(spec) + 1);
+  char **argv = NULL;
+  int argc = 0, count = 0, group = 0, parent = -1, error = word == NULL;
+  *stages = NULL;
+
+  for (const char *p = spec; !error;) {
+    while (*p == ' ' || *p == '\t' || *p == '\n')
+      p++;
+    if (*p == '\0' || *p == '|' || *p == ',') {
+      if (argc == 0) {
+        fprintf(stderr, "lab1: empty command in pipeline\n");
+        error = 1;
+        break;
+      }
+      if (add_stage(stages, &count, argv, parent, output) == -1) {
+        error = 1;
+        break;
+      }
+      argv = NULL;
+      argc = 0;
+      if (*p == '\0')
+        break;
+      if (*p == '|') {
+        if (count - group > 1) {
+          fprintf(stderr, "lab1: only the last stage may have several "
+                          "commands\n");
+          error = 1;
+        }
+        parent = count - 1;
+        group = count;
+      }
+      p++;
+      continue;
+    }
+
+    size_t len = 0;
+    char quote = 0;
+    while (*p != '\0' && (quote || !strchr(" \t\n|,", *p))) {
+      if (quote && *p == quote)
+        quote = 0;
+      else if (!quote && (*p == '\'' || *p == '"'))
+        quote = *p;
+      else if (quote == '"' && *p == '\\' && (p[1] == '"' || p[1] == '\\'))
+        word[len++] = *++p;
+      else
+        word[len++] = *p;
+      p++;
+    }
+    if (quote) {
+      fprintf(stderr, "lab1: unterminated quote in pipeline\n");
+      error = 1;
+    } else if (add_word(&argv, &argc, word, len) == -1) {
+      error = 1;
+    }
+  }
+
+  free(word);
+  if (error) {
+    for (int i = 0; argv && argv[i]; i++)
+      free(argv[i]);
+    free(argv);
+    pipeline_free(*stages, count);
+    *stages = NULL;
+    return -1;
+  }
+  // Only stages nobody reads from write to the output.
+  for (int i = 0; i < group; i++)
+    (*stages)[i].output = -1;
+  return count;
+}
+
+void pipeline_free(pipeline_stage *stages, int count) {
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; stages[i].argv && stages[i].argv[j]; j++)
+      free(stages[i].argv[j]);
+    free(stages[i].argv);
+  }
+  free(stages);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void close_fd(int *fd) {
+  if (*fd != -1)
+    close(*fd);
+  *fd = -1;
+}
+
+// Creates a close-on-exec pipe of the given capacity. The capacity is only a
+// request, the kernel may cap it.
+static int open_pipe(int fds[2], size_t size) {
+  if (pipe2(fds, O_CLOEXEC) == -1) {
+    perror("pipe() failed");
+    fds[0] = fds[1] = -1;
+    return -1;
+  }
+  fcntl(fds[1], F_SETPIPE_SZ, (int)size);
+  return 0;
+}
+
+static void close_link(relay_link *link) {
+  if (link->stage != -1)
+    close_fd(&link->fd);
+  close_fd(&link->staging[0]);
+  close_fd(&link->staging[1]);
+  link->closed = 1;
+}
+
+// The stage closed its output: links without staged data are done.
+static void finish_stage(pipeline_stage *stage, relay *r) {
+  close_fd(&r->out);
+  if (stage->pid != -1)
+    stage->seconds = now() - r->start;
+  for (int i = 0; i < r->link_count; i++)
+    if (!r->links[i].closed && r->links[i].staged == 0)
+      close_link(&r->links[i]);
+}
+
+static void delivered(pipeline_stage *stages, relay_link *link, size_t n) {
+  if (link->stage != -1)
+    stages[link->stage].bytes_in += n;
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// Moves what is available from a stage with a single destination.
+static int relay_direct(pipeline_stage *stages, int index, relay *r,
+                        size_t pipe_size) {
+  relay_link *link = &r->links[0];
+  ssize_t n;
+  if (r->copy) {
+    char buffer[65536];
+    n = read(r->out, buffer, sizeof(buffer));
+    if (n > 0 && write_all(link->fd, buffer, n) == -1)
+      n = -1;
+  } else {
+    n = splice(r->out, NULL, link->fd, NULL, pipe_size, MOVE_FLAGS);
+    if (n == -1 && errno == EINVAL && link->stage == -1) {
+      r->copy = 1;
+      return relay_direct(stages, index, r, pipe_size);
+    }
+  }
+
+  if (n > 0) {
+    stages[index].bytes_out += n;
+    delivered(stages, link, n);
+  } else if (n == 0) {
+    finish_stage(&stages[index], r);
+  } else if (errno == EAGAIN) {
+    link->blocked = 1;
+  } else if (errno == EPIPE) {
+    // The reader is gone; closing the output gives the stage a SIGPIPE, as
+    // in a shell pipeline.
+    close_link(link);
+    finish_stage(&stages[index], r);
+  } else if (errno != EINTR) {
+    perror("splice() failed");
+    close_link(link);
+    finish_stage(&stages[index], r);
+    return -1;
+  }
+  return 0;
+}
+
+// Duplicates the available output of a stage into the staging pipes of all
+// open destinations. It is only called with every staging pipe empty, and a
+// staging pipe holds as many buffers as the output pipe, so tee() copies
+// the same bytes to each of them.
+static int relay_fanout(pipeline_stage *stages, int index, relay *r,
+                        size_t pipe_size) {
+  int open = 0, last = -1;
+  for (int i = 0; i < r->link_count; i++)
+    if (!r->links[i].closed) {
+      open++;
+      last = i;
+    }
+  if (open == 0) {
+    finish_stage(&stages[index], r);
+    return 0;
+  }
+
+  ssize_t size = -1;
+  for (int i = 0; i < r->link_count; i++) {
+    relay_link *link = &r->links[i];
+    if (link->closed)
+      continue;
+    size_t len = size == -1 ? pipe_size : (size_t)size;
+    ssize_t n = i == last
+                    ? splice(r->out, NULL, link->staging[1], NULL, len,
+                             MOVE_FLAGS)
+                    : tee(r->out, link->staging[1], len, SPLICE_F_NONBLOCK);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR) && size == -1)
+      return 0;
+    if (n == 0 && size == -1) {
+      finish_stage(&stages[index], r);
+      return 0;
+    }
+    if (n <= 0 || (size != -1 && n != size)) {
+      fprintf(stderr, "lab1: %s: short copy of a duplicated stream\n",
+              stages[index].argv[0]);
+      for (int j = 0; j < r->link_count; j++)
+        if (!r->links[j].closed)
+          close_link(&r->links[j]);
+      finish_stage(&stages[index], r);
+      return -1;
+    }
+    size = n;
+  }
+  stages[index].bytes_out += size;
+  for (int i = 0; i < r->link_count; i++)
+    if (!r->links[i].closed)
+      r->links[i].staged = size;
+  return 0;
+}
+
+// Moves staged data of a fan-out link to its reader.
+static int relay_staged(pipeline_stage *stages, relay *r, relay_link *link) {
+  ssize_t n = splice(link->staging[0], NULL, link->fd, NULL, link->staged,
+                     MOVE_FLAGS);
+  if (n > 0) {
+    link->staged -= n;
+    delivered(stages, link, n);
+  } else if (n == -1 && errno == EPIPE) {
+    link->staged = 0;
+    close_link(link);
+  } else if (n == -1 && errno != EAGAIN && errno != EINTR) {
+    perror("splice() failed");
+    link->staged = 0;
+    close_link(link);
+    return -1;
+  }
+  if (!link->closed && link->staged == 0 && r->out == -1)
+    close_link(link);
+  return 0;
+}
+
+// Creates the pipes of all stages and starts them. A stage that cannot be
+// started leaves its pipes without a peer, so its reader sees end of file
+// and its writer EPIPE, and the rest of the pipeline still finishes.
+static int setup(pipeline_stage *stages, int count, relay *relays,
+                 int input_fd, size_t pipe_size) {
+  int result = 0;
+  int *outputs = malloc(count * sizeof(int));
+  if (outputs == NULL) {
+    perror("malloc() failed");
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    relay *r = &relays[i];
+    int fds[2];
+    outputs[i] = r->out = r->input = -1;
+    stages[i].pid = -1;
+    stages[i].status = 127;
+    stages[i].bytes_in = stages[i].bytes_out = 0;
+    stages[i].seconds = 0;
+    for (int j = i + 1; j < count; j++)
+      if (stages[j].parent == i)
+        r->link_count++;
+    if (r->link_count == 0)
+      r->link_count = 1;
+    r->links = calloc(r->link_count, sizeof(relay_link));
+    if (r->links == NULL) {
+      perror("malloc() failed");
+      result = -1;
+      break;
+    }
+    for (int j = 0; j < r->link_count; j++) {
+      r->links[j].fd = stages[i].output;
+      r->links[j].stage = -1;
+      r->links[j].staging[0] = r->links[j].staging[1] = -1;
+    }
+    if (open_pipe(fds, pipe_size) == -1) {
+      result = -1;
+      break;
+    }
+    r->out = fds[0];
+    outputs[i] = fds[1];
+    fcntl(r->out, F_SETFL, O_NONBLOCK);
+    if (stages[i].parent == -1)
+      continue;
+
+    relay *from = &relays[stages[i].parent];
+    relay_link *link = from->links;
+    while (link->stage != -1)
+      link++;
+    link->stage = i;
+    if (open_pipe(fds, pipe_size) == -1) {
+      link->fd = -1;
+      result = -1;
+      break;
+    }
+    r->input = fds[0];
+    link->fd = fds[1];
+    fcntl(link->fd, F_SETFL, O_NONBLOCK);
+    if (from->link_count > 1) {
+      if (open_pipe(link->staging, pipe_size) == -1) {
+        result = -1;
+        break;
+      }
+      // Every staging pipe must hold at least what the output pipe does.
+      int size = fcntl(link->staging[1], F_GETPIPE_SZ);
+      if (size > 0 && size < fcntl(from->out, F_GETPIPE_SZ))
+        fcntl(from->out, F_SETPIPE_SZ, size);
+      fcntl(link->staging[0], F_SETFL, O_NONBLOCK);
+      fcntl(link->staging[1], F_SETFL, O_NONBLOCK);
+    }
+  }
+
+  int prepared = result == 0;
+  for (int i = 0; i < count; i++) {
+    relay *r = &relays[i];
+    if (prepared) {
+      r->start = now();
+      stages[i].pid = pipe_exec(
+          stages[i].argv, r->input == -1 ? input_fd : r->input, outputs[i]);
+      if (stages[i].pid == -1)
+        result = -1;
+    }
+    close_fd(&outputs[i]);
+    close_fd(&r->input);
+  }
+  free(outputs);
+  return result;
+}
+
+int pipeline_run(pipeline_stage *stages, int count, int input_fd,
+                 size_t pipe_size) {
+  // A stage has one poll entry for its output and at most one per reader,
+  // and there are fewer readers than stages.
+  relay *relays = calloc(count, sizeof(relay));
+  struct pollfd *fds = malloc(2 * count * sizeof(struct pollfd));
+  int *owner = malloc(2 * count * sizeof(int));
+  int *owner_link = malloc(2 * count * sizeof(int));
+  if (relays == NULL || fds == NULL || owner == NULL || owner_link == NULL) {
+    perror("malloc() failed");
+    free(relays);
+    free(fds);
+    free(owner);
+    free(owner_link);
+    return -1;
+  }
+
+  // Writing to a pipe whose reader exited raises SIGPIPE in the writing
+  // thread. Keep it blocked while relaying and discard it afterwards.
+  sigset_t sigpipe, old_mask;
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+
+  for (int i = 0; i < count; i++)
+    relays[i].out = relays[i].input = -1;
+  int result = setup(stages, count, relays, input_fd, pipe_size);
+  while (1) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+      relay *r = &relays[i];
+      int waiting = 0;
+      if (r->links == NULL)
+        continue;
+      for (int j = 0; j < r->link_count; j++) {
+        relay_link *link = &r->links[j];
+        if (link->closed || (link->staged == 0 && !link->blocked))
+          continue;
+        fds[n] = (struct pollfd){link->fd, POLLOUT, 0};
+        owner[n] = i;
+        owner_link[n++] = j;
+        waiting = 1;
+      }
+      if (r->out != -1 && !waiting) {
+        fds[n] = (struct pollfd){r->out, POLLIN, 0};
+        owner[n] = i;
+        owner_link[n++] = -1;
+      }
+    }
+    if (n == 0)
+      break;
+    if (poll(fds, n, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("poll() failed");
+      result = -1;
+      break;
+    }
+
+    for (int k = 0; k < n; k++) {
+      if (fds[k].revents == 0)
+        continue;
+      relay *r = &relays[owner[k]];
+      int status = 0;
+      if (owner_link[k] == -1 && r->out != -1)
+        status = r->link_count > 1
+                     ? relay_fanout(stages, owner[k], r, pipe_size)
+                     : relay_direct(stages, owner[k], r, pipe_size);
+      else if (owner_link[k] != -1 && r->links[owner_link[k]].blocked)
+        // Go back to waiting for output; moving right away could find the
+        // output empty and mark the link blocked again.
+        r->links[owner_link[k]].blocked = 0;
+      else if (owner_link[k] != -1)
+        status = relay_staged(stages, r, &r->links[owner_link[k]]);
+      if (status == -1)
+        result = -1;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    relay *r = &relays[i];
+    close_fd(&r->out);
+    for (int j = 0; r->links && j < r->link_count; j++)
+      if (!r->links[j].closed)
+        close_link(&r->links[j]);
+    free(r->links);
+    int status;
+    if (stages[i].pid != -1 && waitpid(stages[i].pid, &status, 0) != -1)
+      stages[i].status = WIFEXITED(status) ? WEXITSTATUS(status)
+                                           : 128 + WTERMSIG(status);
+  }
+
+  struct timespec zero = {0, 0};
+  while (sigtimedwait(&sigpipe, NULL, &zero) > 0)
+    ;
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  free(relays);
+  free(fds);
+  free(owner);
+  free(owner_link);
+  return result;
+}
+
+void pipeline_report(const pipeline_stage *stages, int count, FILE *out) {
+  fprintf(out, "%-5s %12s %12s %9s %10s %10s  %s\n", "stage", "bytes in",
+          "bytes out", "seconds", "in MB/s", "out MB/s", "command");
+  for (int i = 0; i < count; i++) {
+    const pipeline_stage *stage = &stages[i];
+    double seconds = stage->seconds > 0 ? stage->seconds : 1e-9;
+    char in[16] = "-", in_rate[16] = "-";
+    if (stage->parent != -1) {
+      snprintf(in, sizeof(in), "%llu", (unsigned long long)stage->bytes_in);
+      snprintf(in_rate, sizeof(in_rate), "%.1f",
+               stage->bytes_in / seconds / 1e6);
+    }
+    fprintf(out, "%-5d %12s %12llu %9.4f %10s %10.1f ", i, in,
+            (unsigned long long)stage->bytes_out, stage->seconds, in_rate,
+            stage->bytes_out / seconds / 1e6);
+    for (int j = 0; stage->argv[j]; j++)
+      fprintf(out, " %s", stage->argv[j]);
+    if (stage->status != 0)
+      fprintf(out, " (exit %d)", stage->status);
+    fputc('\n', out);
+  }
+}
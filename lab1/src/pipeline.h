@@ -0,0 +1,51 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Default capacity requested for every pipe of a pipeline.
+#define PIPELINE_PIPE_SIZE (1 << 20)
+
+// One command of a pipeline. Stages are listed so that every stage comes
+// after the one it reads from; a stage read by several others has its output
+// duplicated to all of them. Stages nobody reads from write to output.
+typedef struct {
+  char **argv;
+  int parent; // stage whose output is the input, -1 for the pipeline input
+  int output; // destination of a final stage
+  // Filled in by pipeline_run().
+  pid_t pid;
+  int status;
+  uint64_t bytes_in;  // bytes delivered to the stage, unknown for the first
+  uint64_t bytes_out; // bytes the stage wrote
+  double seconds;     // from start until its output was closed
+} pipeline_stage;
+
+// Starts cmd with the given standard input and output and returns its pid,
+// or -1 with a diagnostic on stderr. The descriptors are left open.
+pid_t pipe_exec(char *cmd[], int input_fd, int output_fd);
+
+// Parses a command chain: commands separated by '|', each reading the output
+// of the one before. The last stage may list several commands separated by
+// ',' which all read the same input. Words are split on blanks and may be
+// quoted with '' or "". Every final stage gets output as its destination.
+// Returns the number of stages, or -1 with a diagnostic on stderr.
+int pipeline_parse(const char *spec, int output, pipeline_stage **stages);
+
+void pipeline_free(pipeline_stage *stages, int count);
+
+// Runs the stages and waits for all of them. Every stage gets its own pipes
+// of pipe_size bytes and the data is moved between them with splice() and
+// tee(), so it never passes through user space. Returns -1 if a stage could
+// not be started or the data could not be relayed, 0 otherwise; the exit
+// status of every stage is in its status field.
+int pipeline_run(pipeline_stage *stages, int count, int input_fd,
+                 size_t pipe_size);
+
+// Prints the bytes moved and the throughput of every stage.
+void pipeline_report(const pipeline_stage *stages, int count, FILE *out);
+
+#endif
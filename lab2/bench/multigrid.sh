@@ -0,0 +1,53 @@
+#!/bin/sh
+# Compares the time lab2 needs to reach the steady state with the explicit
+# solver and with multigrid.
+#
+#   ./multigrid.sh [-t threads] [size]...
+#
+# Every size is the number of interior nodes along both axes (default 64 to
+# 32767, the largest square under the 2^30 node limit). Per size it prints
+# the wall time of every mode in milliseconds and what the solver reported:
+#   steady  explicit steps at the largest stable time step until no node
+#           changes by more than 1e-6
+#   vcycle  V-cycles from a zero start until the residual is below 1e-6
+#   fmg     one full multigrid pass, then V-cycles as above
+# The explicit solver is skipped above 256 nodes per side: its step count
+# grows with the square of the size and 256 already takes minutes. The plain
+# explicit mode is not timed, it runs a fixed number of steps and never
+# reaches the steady state.
+
+LAB2=${LAB2:-$(dirname "$0")/../src/lab2}
+THREADS=$(nproc 2>/dev/null || echo 1)
+while getopts "t:" opt; do
+  case $opt in
+  t) THREADS=$OPTARG ;;
+  *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+if [ ! -x "$LAB2" ]; then
+  echo "Usage: $0 [-t threads] [size]..." >&2
+  echo "Build $LAB2 first or point LAB2 at the binary." >&2
+  exit 1
+fi
+[ $# -gt 0 ] || set -- 64 256 1024 4096 16384 32767
+
+now_ns() { date +%s%N; }
+
+# run <mode> <size>
+run() {
+  start=$(now_ns)
+  result=$("$LAB2" "$THREADS" 1 "$2" "$2" "$1" | tail -n 1)
+  elapsed=$((($(now_ns) - start) / 1000))
+  awk -v mode="$1" -v size="$2" -v us=$elapsed -v result="$result" \
+    'BEGIN { printf "%6d %-7s %12.2f ms   %s\n", size, mode, us / 1000,
+             result }'
+}
+
+for size in "$@"; do
+  if [ "$size" -le 256 ]; then
+    run steady "$size"
+  fi
+  run vcycle "$size"
+  run fmg "$size"
+done
@@ -4,6 +4,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
 // Define constants for the diffusion equation parameters and boundary
@@ -16,18 +17,81 @@
 #define BOTTOM 20
 #define LEFT 0.4
 #define RIGHT 40
-//#define WRITE_IN_FILE
+// Resolution of the frames unless -r gives one, and frames per unit of model
+// time unless -f does
+#define FRAME_WIDTH 256
+#define FRAME_HEIGHT 256
+#define FRAME_RATE 1
+// Parameters of the steady-state solvers: the residual at which the field is
+// considered steady and the iteration limits of the explicit path and the
+// multigrid cycles
+#define STEADY_TOL 1e-6
+#define STEADY_MAX_STEPS 10000000
+#define MG_MAX_LEVELS 32
+#define MG_MAX_CYCLES 100
+#define MG_PRE_SWEEPS 2
+#define MG_POST_SWEEPS 2
+#define MG_COARSE_SWEEPS 64
+
+// Ways to run the solver: the original time-limited explicit scheme, the same
+// scheme iterated until the field is steady, and multigrid V-cycles started
+// from the initial field or from a full multigrid pass
+enum { MODE_EXPLICIT, MODE_STEADY, MODE_VCYCLE, MODE_FMG };
+
+// Ways to reduce the block of nodes under a pixel to its value: the node in
+// the middle of the block, or the smallest, largest or mean value in it
+enum { POOL_DECIMATE, POOL_MIN, POOL_MAX, POOL_MEAN };
 
 // Define a structure for thread parameters, including thread ID, grid
 // dimensions, time step, and indexes for the portion of the grid each thread is
 // responsible for
 typedef struct {
   pthread_t tid;
+  int id;
   int n, m;
   double dt;
+  int mode;
   int firstIndexStart, firstIndexEnd, secondIndexStart, secondIndexEnd;
 } Thread_param;
 
+// Define structures for the multigrid hierarchy. Along each axis a level has
+// a uniform spacing inside and its own spacing next to the two boundary
+// nodes, which keeps coarse boundaries where the fine ones are for any node
+// count. Per axis it stores the stencil coefficients of the interior nodes
+// and, for every node, the coarse node before it and the weight of the one
+// after it for interpolation
+typedef struct {
+  int n;
+  int factor;
+  double h, first, last;
+  double *west, *east;
+  int *coarse;
+  double *weight;
+} Grid_axis;
+
+// Define a structure for one level: its two axes and the solution and
+// right-hand side stored like the layers (no right-hand side means zero)
+typedef struct {
+  Grid_axis x, y;
+  double *u, *f;
+} Grid_level;
+
+// Define a structure for the visualization output: frames of a fixed
+// resolution written as binary 8-bit PGM images one after another. Pixel
+// rows cover the first grid index, pixel columns the second. The threads
+// reduce their rows of pixels and one of them writes the frame
+typedef struct {
+  FILE *out;
+  int width, height;
+  int pool;
+  double low, high;   // temperatures shown as black and white, the range of
+                      // every frame if they are equal
+  double interval;    // model time between frames
+  float *pixels;
+  unsigned char *raster;
+  long count;
+} Frame_stream;
+
 // Initialize a mutex and a barrier for thread synchronization
 pthread_mutex_t mutx;
 pthread_barrier_t barr;
@@ -35,20 +99,20 @@ pthread_barrier_t barr;
 // temperature grid
 Thread_param *threads;
 double *prevLayer, *currLayer;
-
-// Optionally include a function to write the grid state to a file, used if
-// WRITE_IN_FILE is defined
-#ifdef WRITE_IN_FILE
-void into_file(FILE *output, double *layer, int N, int M) {
-  for (int i = 0; i < N; i++)
-    for (int j = 0; j < M; j++)
-      fprintf(output, "%d %d %lf\n", i, j, layer[N * j + i]);
-  fprintf(output, "\n\n");
-}
-#endif
+// Thread count, per-thread residuals and the shared state of the steady
+// solvers, written by one thread between barriers
+int threadCount;
+double *residuals;
+double residual;
+long steps;
+int steadyDone;
+Grid_level levels[MG_MAX_LEVELS];
+int levelCount;
+Frame_stream frames;
 
 // Function to calculate boundary conditions based on position in the grid
 double boundary(int i, int j, int n, int m, double dt, double T) {
+  (void)dt;
   double grad_top = 1.0;  // Градиент на верхней границе
   double grad_left = 1.0; // Градиент на левой границе
   if (i == 0)
@@ -62,12 +126,107 @@ double boundary(int i, int j, int n, int m, double dt, double T) {
   return T; // Should never reach here.
 }
 
+// Function to split the rows 0..n-1 of a grid between the threads, the first
+// threads take one extra row each when n is not divisible by their count
+void strip(int n, int index, int *start, int *end) {
+  int base = n / threadCount, extra = n % threadCount;
+  *start = index * base + (index < extra ? index : extra);
+  *end = *start + base + (index < extra) - 1;
+}
+
+// Function to reduce the thread's rows of pixels of the current frame from
+// a layer. Every pixel covers a block of nodes of at least one node
+void reduce_frame(Thread_param *param, const double *layer) {
+  int start, end, n = param->n, m = param->m;
+  strip(frames.height, param->id, &start, &end);
+  for (int y = start; y <= end; y++) {
+    int i0 = (long long)y * n / frames.height;
+    int i1 = (long long)(y + 1) * n / frames.height;
+    for (int x = 0; x < frames.width; x++) {
+      int j0 = (long long)x * m / frames.width;
+      int j1 = (long long)(x + 1) * m / frames.width;
+      double value = layer[(long long)n * ((j0 + j1) / 2) + (i0 + i1) / 2];
+      if (frames.pool != POOL_DECIMATE) {
+        double sum = 0;
+        for (int j = j0; j < j1; j++)
+          for (int i = i0; i < i1; i++) {
+            double T = layer[(long long)n * j + i];
+            sum += T;
+            if (frames.pool == POOL_MIN ? T < value : T > value)
+              value = T;
+          }
+        if (frames.pool == POOL_MEAN)
+          value = sum / ((double)(i1 - i0) * (j1 - j0));
+      }
+      frames.pixels[frames.width * y + x] = value;
+    }
+  }
+}
+
+// Function to scale the reduced frame to gray levels and write it with the
+// time it shows and the temperature range in the header comment
+void write_frame(double t) {
+  int size = frames.width * frames.height;
+  double low = frames.low, high = frames.high;
+  if (low == high) {
+    low = high = frames.pixels[0];
+    for (int k = 1; k < size; k++) {
+      if (frames.pixels[k] < low)
+        low = frames.pixels[k];
+      if (frames.pixels[k] > high)
+        high = frames.pixels[k];
+    }
+  }
+  double scale = high > low ? 255 / (high - low) : 0;
+  for (int k = 0; k < size; k++) {
+    double level = (frames.pixels[k] - low) * scale + 0.5;
+    frames.raster[k] = level < 0 ? 0 : level > 255 ? 255 : level;
+  }
+  fprintf(frames.out, "P5\n# frame %ld time %g range %g %g\n%d %d\n255\n",
+          frames.count++, t, low, high, frames.width, frames.height);
+  fwrite(frames.raster, 1, size, frames.out);
+  fflush(frames.out);
+}
+
+// Function to emit a frame of a layer that no thread writes until everyone
+// has passed the next barrier
+void emit_frame(Thread_param *param, const double *layer, double t) {
+  reduce_frame(param, layer);
+  if (pthread_barrier_wait(&barr) == PTHREAD_BARRIER_SERIAL_THREAD)
+    write_frame(t);
+}
+
+// Function to pick the node whose value boundary() extends: for the steady
+// problem the gradient sides continue the neighbouring interior node
+double neighbour(const double *layer, int i, int j, int n) {
+  if (i == 0)
+    return layer[n * j + 1];
+  if (j == 0)
+    return layer[n + i];
+  return layer[n * j + i];
+}
+
+// Function to get the number of frame intervals elapsed by model time t. The
+// tolerance keeps a t that lands on a multiple of the interval from falling
+// just short of it through rounding
+long frame_number(double t) {
+  return (long)(t / frames.interval + 1e-9);
+}
+
 // Main function executed by each thread to solve the heat equation over its
-// part of the grid
+// part of the grid. In the steady mode it runs until the largest change per
+// step, divided by dt, falls below STEADY_TOL. Model time is derived from the
+// step number rather than accumulated, so no step or frame is lost to rounding
 void *solver(void *arg_p) {
   Thread_param *param = (Thread_param *)arg_p;
-  for (double t = 0.0 + param->dt; t <= MTIME; t += param->dt) {
+  int steady = param->mode == MODE_STEADY;
+  long last = (long)(MTIME / param->dt + 1e-9);
+  for (long step = 1; steady || step <= last; step++) {
+    double t = step * param->dt;
     pthread_barrier_wait(&barr);
+    if (steady && steadyDone)
+      break;
+    double change = 0;
     for (int i = param->firstIndexStart; i <= param->firstIndexEnd; i++)
       for (int j = param->secondIndexStart; j <= param->secondIndexEnd; j++) {
         if ((i != 0) && (i != param->n - 1) && (j != 0) &&
@@ -80,38 +239,416 @@ void *solver(void *arg_p) {
                        2 * prevLayer[param->n * j + i] +
                        prevLayer[param->n * (j + 1) + i]) /
                       (dy * dy);
-          currLayer[param->n * j + i] =
-              param->dt * COEF * (x1 + x2) + prevLayer[param->n * j + i];
+          double delta = param->dt * COEF * (x1 + x2);
+          currLayer[param->n * j + i] = delta + prevLayer[param->n * j + i];
+          if (delta > change || -delta > change)
+            change = delta > 0 ? delta : -delta;
         } else {
-          currLayer[param->n * j + i] = boundary(
-              i, j, param->n, param->m, param->dt, prevLayer[param->n * j + i]);
+          currLayer[param->n * j + i] =
+              boundary(i, j, param->n, param->m, param->dt,
+                       steady ? neighbour(prevLayer, i, j, param->n)
+                              : prevLayer[param->n * j + i]);
         }
       }
-    pthread_barrier_wait(&barr);
-#ifdef WRITE_IN_FILE
-    if (pthread_mutex_trylock(&mutx) == 0) {
+    residuals[param->id] = change;
+    // One thread swaps the layers while the others wait at the next barrier
+    if (pthread_barrier_wait(&barr) == PTHREAD_BARRIER_SERIAL_THREAD) {
       double *interm = prevLayer;
       prevLayer = currLayer;
       currLayer = interm;
-      FILE *output = fopen("out", "a");
-      into_file(output, currLayer, param->n, param->m);
-      fclose(output);
-      pthread_mutex_unlock(&mutx);
+      steps++;
+      residual = 0;
+      for (int k = 0; k < threadCount; k++)
+        if (residuals[k] > residual)
+          residual = residuals[k];
+      residual /= param->dt * COEF;
+      steadyDone = residual < STEADY_TOL || steps >= STEADY_MAX_STEPS;
+    }
+    // A frame is due whenever the step crosses a multiple of the interval
+    if (frames.out &&
+        frame_number(t) != frame_number((step - 1) * param->dt)) {
+      pthread_barrier_wait(&barr);
+      emit_frame(param, prevLayer, t);
     }
-#endif
+  }
+  return NULL;
+}
+
+// Function to get the slope of boundary() in T at a node: 1 on the gradient
+// sides, where the node continues its interior neighbour, 0 on fixed ones
+double boundary_slope(int i, int j, int n, int m) {
+  return boundary(i, j, n, m, 0, 1) - boundary(i, j, n, m, 0, 0);
+}
+
+// Function to give a boundary node of a multigrid level the value boundary()
+// rules assign to it. Coarse levels stretch the gradient to their spacing at
+// that side, and corrections satisfy the homogeneous form of the conditions
+double level_boundary(const Grid_level *g, int i, int j, double T,
+                      int homogeneous) {
+  int n = g->x.n, m = g->y.n;
+  double a = boundary_slope(i, j, n, m);
+  if (homogeneous)
+    return a * T;
+  double b = boundary(i, j, n, m, 0, 0);
+  if (a != 0)
+    b *= i == 0       ? g->x.first / dx
+         : i == n - 1 ? g->x.last / dx
+         : j == 0     ? g->y.first / dy
+                      : g->y.last / dy;
+  return a * T + b;
+}
+
+// Function to update the boundary nodes of a thread's strip from the interior
+void apply_boundary(Thread_param *param, Grid_level *g, int homogeneous) {
+  int start, end, n = g->x.n, m = g->y.n;
+  strip(n, param->id, &start, &end);
+  for (int i = start; i <= end; i++) {
+    int step = (i == 0 || i == n - 1) ? 1 : m - 1;
+    for (int j = 0; j < m; j += step) {
+      // The corners are not part of any stencil, and reading the node next
+      // to them could race with the thread that owns it
+      double T = 0;
+      if (i == 0 && j > 0 && j < m - 1)
+        T = g->u[n * j + 1];
+      else if (i == n - 1 && j > 0 && j < m - 1)
+        T = g->u[n * j + n - 2];
+      else if (j == 0 && i > 0 && i < n - 1)
+        T = g->u[n + i];
+      else if (j == m - 1 && i > 0 && i < n - 1)
+        T = g->u[n * (m - 2) + i];
+      g->u[n * j + i] = level_boundary(g, i, j, T, homogeneous);
+    }
+  }
+}
+
+// Function to run red-black Gauss-Seidel sweeps of -laplace(u) = f over the
+// interior of a thread's strip; the boundary is refreshed before every color
+void smooth(Thread_param *param, Grid_level *g, int sweeps, int homogeneous) {
+  int start, end, n = g->x.n;
+  strip(n, param->id, &start, &end);
+  if (start < 1)
+    start = 1;
+  if (end > n - 2)
+    end = n - 2;
+  double *u = g->u;
+  for (int s = 0; s < sweeps; s++)
+    for (int color = 0; color < 2; color++) {
+      apply_boundary(param, g, homogeneous);
+      pthread_barrier_wait(&barr);
+      for (int j = 1; j < g->y.n - 1; j++) {
+        double south = g->y.west[j], north = g->y.east[j];
+        for (int i = start + ((start + j + color) & 1); i <= end; i += 2) {
+          int k = n * j + i;
+          double west = g->x.west[i], east = g->x.east[i];
+          u[k] = (west * u[k - 1] + east * u[k + 1] + south * u[k - n] +
+                  north * u[k + n] + (g->f ? g->f[k] : 0)) /
+                 (west + east + south + north);
+        }
+      }
+      pthread_barrier_wait(&barr);
+    }
+}
+
+// Function to compute the residual f + laplace(u) at a node, zero on the
+// boundary where the values are given
+double node_residual(const Grid_level *g, int i, int j) {
+  int n = g->x.n;
+  if (i <= 0 || i >= n - 1 || j <= 0 || j >= g->y.n - 1)
+    return 0;
+  int k = n * j + i;
+  double *u = g->u;
+  return (g->f ? g->f[k] : 0) + g->x.west[i] * (u[k - 1] - u[k]) +
+         g->x.east[i] * (u[k + 1] - u[k]) + g->y.west[j] * (u[k - n] - u[k]) +
+         g->y.east[j] * (u[k + n] - u[k]);
+}
+
+// Function to get the largest residual of a level over all threads
+double residual_norm(Thread_param *param, Grid_level *g, int homogeneous) {
+  int start, end;
+  strip(g->x.n, param->id, &start, &end);
+  apply_boundary(param, g, homogeneous);
+  pthread_barrier_wait(&barr);
+  double norm = 0;
+  for (int j = 1; j < g->y.n - 1; j++)
+    for (int i = start; i <= end; i++) {
+      double r = node_residual(g, i, j);
+      if (r > norm || -r > norm)
+        norm = r > 0 ? r : -r;
+    }
+  residuals[param->id] = norm;
+  pthread_barrier_wait(&barr);
+  norm = 0;
+  for (int k = 0; k < threadCount; k++)
+    if (residuals[k] > norm)
+      norm = residuals[k];
+  // Nobody may overwrite the residuals before everyone has read them
+  pthread_barrier_wait(&barr);
+  return norm;
+}
+
+// Function to move the residual of a level to the next coarser one with
+// full weighting and to clear the coarse correction. The fine boundary must
+// be up to date
+void restrict_residual(Thread_param *param, Grid_level *fine,
+                       Grid_level *coarse) {
+  int start, end, n = coarse->x.n;
+  strip(n, param->id, &start, &end);
+  int rangeX = fine->x.factor - 1, rangeY = fine->y.factor - 1;
+  for (int J = 0; J < coarse->y.n; J++)
+    for (int I = start; I <= end; I++) {
+      double r = 0;
+      for (int b = -rangeY; b <= rangeY; b++)
+        for (int a = -rangeX; a <= rangeX; a++)
+          r += (a ? 0.25 : 0.5 * rangeX + 1 - rangeX) *
+               (b ? 0.25 : 0.5 * rangeY + 1 - rangeY) *
+               node_residual(fine, I * fine->x.factor + a,
+                             J * fine->y.factor + b);
+      coarse->f[n * J + I] = r;
+      coarse->u[n * J + I] = 0;
+    }
+  pthread_barrier_wait(&barr);
+}
+
+// Function to interpolate a coarse level bilinearly onto the interior of the
+// next finer one, adding to it for a correction or replacing it otherwise.
+// The coarse boundary must be up to date
+void prolong(Thread_param *param, Grid_level *coarse, Grid_level *fine,
+             int add) {
+  int start, end, n = fine->x.n, cn = coarse->x.n;
+  strip(n, param->id, &start, &end);
+  if (start < 1)
+    start = 1;
+  if (end > n - 2)
+    end = n - 2;
+  for (int j = 1; j < fine->y.n - 1; j++) {
+    const double *row = coarse->u + cn * fine->y.coarse[j];
+    double wy = fine->y.weight[j];
+    for (int i = start; i <= end; i++) {
+      int I = fine->x.coarse[i];
+      double wx = fine->x.weight[i];
+      double value = (1 - wy) * ((1 - wx) * row[I] + wx * row[I + 1]) +
+                     wy * ((1 - wx) * row[cn + I] + wx * row[cn + I + 1]);
+      if (add)
+        fine->u[n * j + i] += value;
+      else
+        fine->u[n * j + i] = value;
+    }
+  }
+  pthread_barrier_wait(&barr);
+}
+
+// Function to run one V-cycle on a level: smoothing, correction from the
+// coarser levels, smoothing again. Only the level the cycle starts on solves
+// the problem itself, the coarser ones solve for corrections
+void vcycle(Thread_param *param, int level, int homogeneous) {
+  Grid_level *g = &levels[level];
+  if (level == levelCount - 1) {
+    smooth(param, g, MG_COARSE_SWEEPS, homogeneous);
+    return;
+  }
+  smooth(param, g, MG_PRE_SWEEPS, homogeneous);
+  apply_boundary(param, g, homogeneous);
+  pthread_barrier_wait(&barr);
+  restrict_residual(param, g, g + 1);
+  vcycle(param, level + 1, 1);
+  apply_boundary(param, g + 1, 1);
+  pthread_barrier_wait(&barr);
+  prolong(param, g + 1, g, 1);
+  smooth(param, g, MG_POST_SWEEPS, homogeneous);
+}
+
+// Function to run full multigrid: solve on the coarsest level, then
+// interpolate each solution to the next finer level as the starting point of
+// a V-cycle there
+void full_multigrid(Thread_param *param) {
+  Grid_level *g = &levels[levelCount - 1];
+  int start, end;
+  strip(g->x.n, param->id, &start, &end);
+  for (int j = 0; j < g->y.n; j++)
+    for (int i = start; i <= end; i++)
+      g->u[g->x.n * j + i] = 0;
+  pthread_barrier_wait(&barr);
+  smooth(param, g, MG_COARSE_SWEEPS, 0);
+  for (int level = levelCount - 2; level >= 0; level--) {
+    apply_boundary(param, &levels[level + 1], 0);
+    pthread_barrier_wait(&barr);
+    prolong(param, &levels[level + 1], &levels[level], 0);
+    vcycle(param, level, 0);
+  }
+}
+
+// Function to fill in the stencil coefficients of an axis from its spacing
+void init_axis(Grid_axis *axis) {
+  axis->west = calloc(axis->n, sizeof(double));
+  axis->east = calloc(axis->n, sizeof(double));
+  axis->coarse = calloc(axis->n, sizeof(int));
+  axis->weight = calloc(axis->n, sizeof(double));
+  for (int i = 1; i < axis->n - 1; i++) {
+    double left = i == 1 ? axis->first : axis->h;
+    double right = i == axis->n - 2 ? axis->last : axis->h;
+    axis->west[i] = 2 / (left * (left + right));
+    axis->east[i] = 2 / (right * (left + right));
+  }
+}
+
+// Function to derive the next coarser axis. Every other node is kept and the
+// boundary nodes stay where they are: a fixed side keeps its position, and
+// on a gradient side the coarse boundary node is placed so that the point
+// midway to the first interior node, where the gradient applies, is the
+// same as on the fine axis. Records for every fine node where it lies
+// between the coarse ones
+Grid_axis coarsen_axis(Grid_axis *fine, double slopeFirst, double slopeLast) {
+  int n = fine->n;
+  Grid_axis coarse = {.n = n / 2 + 1, .factor = 1, .h = 2 * fine->h};
+  coarse.first = fine->first + (slopeFirst != 0 ? 2 : 1) * fine->h;
+  coarse.last = n % 2 ? fine->last + (slopeLast != 0 ? 2 : 1) * fine->h
+                      : fine->last;
+  init_axis(&coarse);
+  fine->factor = 2;
+  // Positions along the fine axis with its first boundary node at 0. Coarse
+  // node I is fine node 2I, except for the boundary nodes
+  double h = fine->h, first = fine->first;
+  double coarseFirst = first + h - coarse.first;
+  double coarseLast = first + (2 * coarse.n - 5) * h + coarse.last;
+  for (int i = 1; i < n - 1; i++) {
+    double x = first + (i - 1) * h;
+    int I = i / 2;
+    double left = I == 0 ? coarseFirst : first + (2 * I - 1) * h;
+    double right = I + 1 == coarse.n - 1 ? coarseLast : first + (2 * I + 1) * h;
+    fine->coarse[i] = I;
+    fine->weight[i] = (x - left) / (right - left);
+  }
+  return coarse;
+}
+
+// Function to build the multigrid hierarchy on top of the finest level.
+// Each level halves every axis that still has more than two interior nodes
+void build_levels(double *u, int N, int M) {
+  levels[0] = (Grid_level){.x = {.n = N, .factor = 1, .h = dx, .first = dx,
+                                 .last = dx},
+                           .y = {.n = M, .factor = 1, .h = dy, .first = dy,
+                                 .last = dy},
+                           .u = u};
+  init_axis(&levels[0].x);
+  init_axis(&levels[0].y);
+  for (int i = 0; i < N; i++)
+    levels[0].x.coarse[i] = i;
+  for (int j = 0; j < M; j++)
+    levels[0].y.coarse[j] = j;
+  // Which sides are gradient sides, asked from boundary() in their middle
+  double top = boundary_slope(0, M / 2, N, M);
+  double bottom = boundary_slope(N - 1, M / 2, N, M);
+  double left = boundary_slope(N / 2, 0, N, M);
+  double right = boundary_slope(N / 2, M - 1, N, M);
+  levelCount = 1;
+  while (levelCount < MG_MAX_LEVELS) {
+    Grid_level *g = &levels[levelCount - 1];
+    int coarsenX = g->x.n - 2 > 2, coarsenY = g->y.n - 2 > 2;
+    if (!coarsenX && !coarsenY)
+      break;
+    Grid_level *c = &levels[levelCount++];
+    c->x = coarsenX ? coarsen_axis(&g->x, top, bottom) : g->x;
+    c->y = coarsenY ? coarsen_axis(&g->y, left, right) : g->y;
+    if (!coarsenX)
+      init_axis(&c->x);
+    if (!coarsenY)
+      init_axis(&c->y);
+    c->u = calloc(c->x.n * c->y.n, sizeof(double));
+    c->f = calloc(c->x.n * c->y.n, sizeof(double));
+  }
+  for (int l = 0; l < levelCount; l++) {
+    Grid_axis *axes[2] = {&levels[l].x, &levels[l].y};
+    for (int k = 0; k < 2; k++)
+      if (axes[k]->factor == 1)
+        for (int i = 0; i < axes[k]->n; i++) {
+          axes[k]->coarse[i] = i < axes[k]->n - 1 ? i : i - 1;
+          axes[k]->weight[i] = i < axes[k]->n - 1 ? 0 : 1;
+        }
+  }
+}
+
+// Main function executed by each thread for the multigrid modes: V-cycles on
+// the finest level until its residual falls below STEADY_TOL. Every cycle
+// makes a frame, its number stands for the time
+void *multigrid(void *arg_p) {
+  Thread_param *param = (Thread_param *)arg_p;
+  if (param->mode == MODE_FMG)
+    full_multigrid(param);
+  for (int cycle = 0;; cycle++) {
+    double norm = residual_norm(param, &levels[0], 0);
+    if (param->id == 0) {
+      residual = norm;
+      steps = cycle;
+    }
+    if (frames.out)
+      emit_frame(param, levels[0].u, cycle);
+    if (norm < STEADY_TOL || cycle == MG_MAX_CYCLES)
+      break;
+    vcycle(param, 0, 0);
   }
   return NULL;
 }
 
 int main(int argc, char *argv[]) {
+  // Options in front of the arguments configure the frames: -o names the
+  // file or pipe to stream them to ("-" for stdout), -r the resolution as
+  // WIDTHxHEIGHT, -f the frames per unit of model time, -p how blocks of
+  // nodes are pooled and -z a fixed temperature range as LOW:HIGH
+  const char *pools[] = {"decimate", "min", "max", "mean"};
+  const char *path = NULL;
+  double rate = FRAME_RATE;
+  frames = (Frame_stream){.width = FRAME_WIDTH, .height = FRAME_HEIGHT,
+                          .pool = POOL_MEAN};
+  int opt;
+  while ((opt = getopt(argc, argv, "o:r:f:p:z:")) != -1) {
+    int valid = 1;
+    if (opt == 'o')
+      path = optarg;
+    else if (opt == 'r')
+      valid = sscanf(optarg, "%dx%d", &frames.width, &frames.height) == 2 &&
+              frames.width > 0 && frames.height > 0;
+    else if (opt == 'f')
+      valid = (rate = atof(optarg)) > 0;
+    else if (opt == 'p') {
+      frames.pool = -1;
+      for (int i = 0; i < 4; i++)
+        if (strcmp(optarg, pools[i]) == 0)
+          frames.pool = i;
+      valid = frames.pool != -1;
+    } else if (opt == 'z')
+      valid = sscanf(optarg, "%lf:%lf", &frames.low, &frames.high) == 2 &&
+              frames.low < frames.high;
+    else
+      valid = 0;
+    if (!valid) {
+      printf("Usage: %s [-o frames] [-r WIDTHxHEIGHT] [-f rate] "
+             "[-p decimate|min|max|mean] [-z LOW:HIGH] <threads> <dt> <n> <m> "
+             "[explicit|steady|vcycle|fmg]\n",
+             argv[0]);
+      return -5;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
   // Check for valid command-line arguments and handle various constraints and
   // errors
-  if (argc != 5) {
+  if (argc != 5 && argc != 6) {
     printf("Invalid argc\n");
     return -1;
   }
-  unsigned int value = (1U << 30) - 2;
-  if ((atoi(argv[3]) * atoi(argv[4])) > value) {
+  // The optional fifth argument selects the solver
+  const char *modes[] = {"explicit", "steady", "vcycle", "fmg"};
+  int mode = argc == 6 ? -1 : MODE_EXPLICIT;
+  for (int i = 0; argc == 6 && i < 4; i++)
+    if (strcmp(argv[5], modes[i]) == 0)
+      mode = i;
+  if (mode == -1) {
+    printf("Invalid mode, expected explicit, steady, vcycle or fmg\n");
+    return -4;
+  }
+  // The product is taken in long long so that large sizes cannot overflow it
+  long long value = (1LL << 30) - 2;
+  if ((long long)atoi(argv[3]) * atoi(argv[4]) > value) {
     printf("Too many nodes\n");
     return -3;
   }
@@ -119,51 +656,78 @@ int main(int argc, char *argv[]) {
   // dimensions
   int count = atoi(argv[1]), N = atoi(argv[3]) + 2, M = atoi(argv[4]) + 2;
   double dt = atof(argv[2]);
+  threadCount = count;
+  // The steady explicit path runs at the largest stable step at most
+  double dtMax = 1 / (2 * COEF * (1.0 / (dx * dx) + 1.0 / (dy * dy)));
+  if (mode == MODE_STEADY && dt > dtMax)
+    dt = dtMax;
+  // Open the frame output; the reports move to stderr when frames go to
+  // stdout. A frame never has more pixels than the grid has nodes
+  FILE *report = stdout;
+  if (path) {
+    frames.out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!frames.out) {
+      printf("Error opening %s\n", path);
+      return -5;
+    }
+    if (frames.out == stdout)
+      report = stderr;
+    if (frames.width > M)
+      frames.width = M;
+    if (frames.height > N)
+      frames.height = N;
+    frames.interval = 1 / rate;
+    frames.pixels = calloc(frames.width * frames.height, sizeof(float));
+    frames.raster = malloc(frames.width * frames.height);
+  }
   // Record start time for measuring execution time
   struct timeval start, end;
   gettimeofday(&start, NULL);
   // Allocate memory for storing the grid states
   prevLayer = calloc(N * M, sizeof(double));
-  currLayer = calloc(N * M, sizeof(double));
+  if (mode == MODE_EXPLICIT || mode == MODE_STEADY)
+    currLayer = calloc(N * M, sizeof(double));
   // Initialize pthread attributes, mutex, and barrier
   pthread_attr_t attr;
   pthread_mutex_init(&mutx, NULL);
   pthread_barrier_init(&barr, NULL, count);
+  residuals = calloc(count, sizeof(double));
+  // The multigrid levels are built on top of the grid itself
+  if (mode >= MODE_VCYCLE)
+    build_levels(prevLayer, N, M);
   // Allocate memory for thread parameters and configure each thread's part of
   // the grid
   threads = calloc(count, sizeof(Thread_param));
   // Initialize the grid with boundary conditions
   for (int i = 0; i < count; i++) {
-    threads[i] = (Thread_param){.n = N,
+    threads[i] = (Thread_param){.id = i,
+                                .n = N,
                                 .m = M,
                                 .dt = dt,
-                                .firstIndexStart = 1 + i * ((N - 2) / count),
-                                .firstIndexEnd = (i + 1) * ((N - 2) / count),
+                                .mode = mode,
                                 .secondIndexStart = 0,
                                 .secondIndexEnd = M - 1};
-    if (i == 0)
-      threads[i].firstIndexStart--;
-    if (i == count - 1)
-      threads[i].firstIndexEnd++;
+    strip(N, i, &threads[i].firstIndexStart, &threads[i].firstIndexEnd);
   }
   for (int i = 0; i < N; i++)
     for (int j = 0; j < M; j++)
       prevLayer[N * j + i] = (i == 0 || i == N - 1 || j == 0 || j == M - 1)
                                  ? boundary(i, j, N, M, dt, 0.01)
                                  : 0;
-      // Optionally write the initial grid state to a file
-#ifdef WRITE_IN_FILE
-  FILE *output = fopen("out", "w");
-  into_file(output, prevLayer, N, M);
-  fclose(output);
-#endif
+  // The time-stepping modes start their frames with the initial field
+  if (frames.out && mode <= MODE_STEADY) {
+    for (int i = 0; i < count; i++)
+      reduce_frame(&threads[i], prevLayer);
+    write_frame(0);
+  }
   // Set pthread attributes for system-wide contention scope and joinable state
   pthread_attr_init(&attr);
   pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   // Create threads to start solving the heat equation
   for (int i = 0; i < count; i++)
-    pthread_create(&threads[i].tid, &attr, solver, &threads[i]);
+    pthread_create(&threads[i].tid, &attr,
+                   mode >= MODE_VCYCLE ? multigrid : solver, &threads[i]);
   // Join threads after completion
   for (int i = 0; i < count; i++)
     pthread_join(threads[i].tid, NULL);
@@ -174,25 +738,47 @@ int main(int argc, char *argv[]) {
   gettimeofday(&end, NULL);
   long seconds = (end.tv_sec - start.tv_sec);
   long micros = ((seconds * 1000000) + end.tv_usec) - (start.tv_usec);
-  printf("Execution time: %ld seconds, %ld microseconds\n", seconds, micros);
-  // Optionally write a configuration file for gnuplot to visualize the results
-#ifdef WRITE_IN_FILE
-  FILE *fp = fopen("gnuplot.cfg", "w");
-  if (fp) {
-    char *message;
-    fprintf(fp,
-            "set term gif animate\nset output 'animation.gif'\nset zrange "
-            "[0:50]\nset dgrid3d\nset hidden3d\ndo for [i=0:%d] {\nsplot 'out' "
-            "index i using 1:2:3 with lines\n}",
-            (int)(MTIME / dt) + 1);
-    fclose(fp);
-    printf("gnuplot -persist gnuplot.cfg\n");
-  } else {
-    printf("Error recording gnuplot config\n");
-  }
-#endif
+  fprintf(report, "Execution time: %ld seconds, %ld microseconds\n", seconds,
+          micros);
+  // Report how far the steady solvers got and the mean interior temperature
+  // so that their fields can be compared
+  if (mode != MODE_EXPLICIT) {
+    double sum = 0;
+    for (int j = 1; j < M - 1; j++)
+      for (int i = 1; i < N - 1; i++)
+        sum += prevLayer[N * j + i];
+    fprintf(report, "%s: %ld %s, residual %.3e%s, mean temperature %f\n",
+            modes[mode], steps, mode == MODE_STEADY ? "steps" : "cycles",
+            residual, residual < STEADY_TOL ? "" : " (not converged)",
+            sum / ((double)(N - 2) * (M - 2)));
+  }
+  // Tell how to turn the frames into an animation
+  if (frames.out) {
+    fprintf(report, "%ld frames of %dx%d written to %s\n", frames.count,
+            frames.width, frames.height, path);
+    if (frames.out != stdout) {
+      fclose(frames.out);
+      fprintf(report, "ffmpeg -f pgm_pipe -i %s animation.gif\n", path);
+    }
+  }
   free(prevLayer);
   free(currLayer);
   free(threads);
+  free(residuals);
+  free(frames.pixels);
+  free(frames.raster);
+  for (int l = 0; l < levelCount; l++) {
+    Grid_axis *axes[2] = {&levels[l].x, &levels[l].y};
+    for (int k = 0; k < 2; k++) {
+      free(axes[k]->west);
+      free(axes[k]->east);
+      free(axes[k]->coarse);
+      free(axes[k]->weight);
+    }
+    if (l > 0) {
+      free(levels[l].u);
+      free(levels[l].f);
+    }
+  }
   return 0;
 }
\ No newline at end of file
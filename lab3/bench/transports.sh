@@ -0,0 +1,60 @@
+#!/bin/sh
+# Plays the same load over every transport of the lab3 server and prints the
+# request rate and latencies loadgen reports for each.
+#
+#   ./transports.sh [-c connections] [-g games] [-t threads] [conffile]
+#
+# A server is started on a Unix socket next to its TCP port and stopped at the
+# end. The configuration should give enough attempts to finish the binary
+# search, e.g. 20 attempts over a range of a million, so that requests rather
+# than reconnects dominate. Rows:
+#   tcp    loopback TCP
+#   unix   Unix stream socket
+#   shm    shared-memory channel set up through the Unix socket; its
+#          handshake includes mapping the channel
+
+BIN=${BIN:-$(dirname "$0")/../src}
+CONNECTIONS=1
+GAMES=2000
+THREADS=1
+while getopts "c:g:t:" opt; do
+  case $opt in
+  c) CONNECTIONS=$OPTARG ;;
+  g) GAMES=$OPTARG ;;
+  t) THREADS=$OPTARG ;;
+  *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+if [ ! -x "$BIN/server" ] || [ ! -x "$BIN/loadgen" ]; then
+  echo "Usage: $0 [-c connections] [-g games] [-t threads] [conffile]" >&2
+  echo "Build server and loadgen in $BIN first or point BIN at them." >&2
+  exit 1
+fi
+
+CONF=${1:-$(dirname "$0")/../src/conffile.txt}
+PORT=$(sed -n 2p "$CONF")
+SOCKET=$(mktemp -u "${TMPDIR:-/tmp}/lab3-bench.XXXXXX")
+"$BIN/server" -U "$SOCKET" "$CONF" >/dev/null 2>&1 &
+SERVER=$!
+trap 'kill $SERVER; rm -f "$SOCKET"' EXIT
+sleep 1
+
+# run <name> <loadgen options>...
+run() {
+  name=$1
+  shift
+  "$BIN/loadgen" -p "$PORT" -c "$CONNECTIONS" -g "$GAMES" -t "$THREADS" \
+    -n "$name$$" "$@" |
+    awk -v name="$name" '
+      /^Requests:/ { rate = $3; gsub(/[(]|[/]s[)]/, "", rate) }
+      /^handshake/ { handshake = $2 }
+      /^request/ { p50 = $2; p99 = $3; mean = $6 }
+      END { printf "%-5s %12s req/s   handshake p50 %8s   request p50 %7s " \
+                   "p99 %7s mean %7s us\n", name, rate, handshake, p50, p99,
+                   mean }'
+}
+
+run tcp
+run unix -u "$SOCKET"
+run shm -s "$SOCKET"
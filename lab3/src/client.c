@@ -6,30 +6,201 @@
  * This client program interacts with a game server to play a simple "Guess the
  * Number" game. It uses TCP/IP sockets to send guesses and receive responses,
  * and provides a text-based interface for the user to play the game.
+ *
+ * One process drives any number of sessions: all sockets are non-blocking and
+ * served, together with the terminal, by a single poll() loop. The moves of a
+ * session are typed by the user, read from a script file that every session
+ * plays, or chosen by a solver that halves the range with every question, so
+ * the client doubles as a test harness for hundreds of players. On a terminal
+ * the screen shows one row per session and only rows whose text changed are
+ * rewritten; otherwise every response is printed as a line.
  */
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "protocol.h"
+
 #define BUFFER_SIZE 256
 #define PORT 8080
+#define INPUT_SIZE 64
+#define HEADER_ROWS 4
+#define FOOTER_ROWS 2
+
+/**
+ * @enum SessionState
+ * @brief Progress of a session.
+ */
+typedef enum {
+  SESSION_CONNECTING, /**< Non-blocking connect in progress. */
+  SESSION_HELLO,      /**< Name sent, waiting for the hello message. */
+  SESSION_READY,      /**< Waiting for the next move. */
+  SESSION_WAITING,    /**< Move sent, waiting for the response. */
+  SESSION_DONE        /**< Game over or connection closed. */
+} SessionState;
+
+/**
+ * @enum InputMode
+ * @brief Where the moves of the sessions come from.
+ */
+typedef enum {
+  INPUT_INTERACTIVE, /**< Lines typed by the user, for the selected session. */
+  INPUT_SCRIPT,      /**< Lines of the script file, played by every session. */
+  INPUT_SOLVER       /**< Binary search over the range. */
+} InputMode;
+
+/**
+ * @struct Options
+ * @brief Command line settings.
+ *
+ * @var Options::host
+ * Server address.
+ * @var Options::port
+ * Server port.
+ * @var Options::name
+ * Player name, suffixed with the session number if there are several.
+ * @var Options::sessions
+ * Number of sessions to play.
+ * @var Options::script
+ * Path of the script file, NULL if none.
+ * @var Options::mode
+ * Source of the moves.
+ */
+typedef struct {
+  char *host;
+  int port;
+  char *name;
+  int sessions;
+  char *script;
+  InputMode mode;
+} Options;
+
+/**
+ * @struct Session
+ * @brief State of one game.
+ *
+ * @var Session::sock
+ * Socket connected to the server, -1 once closed.
+ * @var Session::name
+ * Player name.
+ * @var Session::state
+ * Progress of the session.
+ * @var Session::attempts
+ * Attempts left.
+ * @var Session::min
+ * The minimum number in the guessing range.
+ * @var Session::max
+ * The maximum number in the guessing range.
+ * @var Session::low
+ * Lowest number the solver has not ruled out.
+ * @var Session::high
+ * Highest number the solver has not ruled out.
+ * @var Session::asked
+ * Number in the solver's last question.
+ * @var Session::questions
+ * Questions answered by the server.
+ * @var Session::script_line
+ * Next line of the script to play.
+ * @var Session::output
+ * Bytes waiting to be sent.
+ * @var Session::output_length
+ * Number of bytes in output.
+ * @var Session::last_input
+ * The last move, as typed or scripted.
+ * @var Session::last_response
+ * The last response, readable.
+ * @var Session::result
+ * Final response character, 0 while the game goes on.
+ */
+typedef struct {
+  int sock;
+  char name[BUFFER_SIZE];
+  SessionState state;
+  int attempts;
+  int min;
+  int max;
+  int low;
+  int high;
+  int asked;
+  int questions;
+  int script_line;
+  char output[BUFFER_SIZE];
+  size_t output_length;
+  char last_input[INPUT_SIZE];
+  char last_response[BUFFER_SIZE];
+  char result;
+} Session;
+
+/**
+ * @struct Client
+ * @brief State of the event loop.
+ *
+ * @var Client::sessions
+ * All sessions.
+ * @var Client::count
+ * Number of sessions.
+ * @var Client::active
+ * Sessions not done yet.
+ * @var Client::mode
+ * Source of the moves.
+ * @var Client::script
+ * Lines of the script file.
+ * @var Client::script_lines
+ * Number of script lines.
+ * @var Client::current
+ * Session that typed lines go to.
+ * @var Client::stdin_open
+ * Whether typed lines are still read.
+ * @var Client::input
+ * Typed characters not yet ending in a newline.
+ * @var Client::input_length
+ * Number of characters in input.
+ * @var Client::tty
+ * Whether the output is a terminal showing the session table.
+ * @var Client::rows
+ * Terminal height.
+ * @var Client::columns
+ * Terminal width.
+ * @var Client::shown
+ * Text of every screen row as last drawn.
+ * @var Client::dirty
+ * Whether anything changed since the last redraw.
+ */
+typedef struct {
+  Session *sessions;
+  int count;
+  int active;
+  InputMode mode;
+  char **script;
+  int script_lines;
+  int current;
+  bool stdin_open;
+  char input[BUFFER_SIZE];
+  size_t input_length;
+  bool tty;
+  int rows;
+  int columns;
+  char **shown;
+  bool dirty;
+} Client;
 
 /**
  * @brief Parses and validates command line arguments.
  * @param argc Argument count.
  * @param argv Argument vector.
- * @param host Pointer to host address string.
- * @param port Pointer to port number.
- * @param name Pointer to username string.
+ * @param options Receives the settings.
  * @return True if arguments are valid, false otherwise.
  */
-bool parse_and_validate_args(int argc, char *argv[], char **host, int *port,
-                             char **name);
+bool parse_and_validate_args(int argc, char *argv[], Options *options);
 
 /**
  * @brief Parses the client's textual input into game-specific commands.
@@ -47,28 +218,105 @@ char *parse_client_input(const char *input);
 char *parse_server_response(char response);
 
 /**
- * @brief Displays the current state of the game including user inputs and
- * server responses.
- * @param username The user's name.
- * @param attempts The number of attempts remaining.
- * @param min The minimum number in the guessing range.
- * @param max The maximum number in the guessing range.
- * @param last_input The last input given by the user.
- * @param last_response The last response received from the server.
+ * @brief Reads the script file into memory, one entry per line.
+ * @param client Pointer to the client state.
+ * @param path Path of the script file.
+ * @return True on success, false if the file cannot be read.
+ */
+bool load_script(Client *client, const char *path);
+
+/**
+ * @brief Starts a non-blocking connection and queues the player name.
+ * @param session Session to start; its name must be set.
+ * @param address Server address.
+ */
+void start_session(Session *session, const struct sockaddr_in *address);
+
+/**
+ * @brief Sends as much of the queued output as the socket takes.
+ * @param client Pointer to the client state.
+ * @param session Session with queued output.
+ */
+void flush_output(Client *client, Session *session);
+
+/**
+ * @brief Handles readiness of a session's socket.
+ * @param client Pointer to the client state.
+ * @param session Session whose socket is ready.
+ * @param revents Events reported by poll().
+ */
+void handle_session_event(Client *client, Session *session, short revents);
+
+/**
+ * @brief Handles a message received from the server.
+ * @param client Pointer to the client state.
+ * @param session Session the message belongs to.
+ * @param message Received message, '\0'-terminated.
+ */
+void handle_response(Client *client, Session *session, const char *message);
+
+/**
+ * @brief Queues the next move of a ready session from its script or the
+ * solver.
+ * @param client Pointer to the client state.
+ * @param session Ready session.
+ */
+void play_next_move(Client *client, Session *session);
+
+/**
+ * @brief Queues a move typed by the user or scripted.
+ * @param client Pointer to the client state.
+ * @param session Ready session.
+ * @param input Move in the client's text language.
+ */
+void play_input(Client *client, Session *session, const char *input);
+
+/**
+ * @brief Reads typed characters and handles every complete line.
+ * @param client Pointer to the client state.
+ */
+void read_terminal(Client *client);
+
+/**
+ * @brief Plays the complete typed lines the selected session is ready for.
+ *
+ * Lines typed while the selected session waits for the server are kept
+ * until it is ready, so piped input plays like a script.
+ *
+ * @param client Pointer to the client state.
  */
-void display_game_state(const char *username, int attempts, int min, int max,
-                        const char *last_input, const char *last_response);
+void play_typed_lines(Client *client);
+
+/**
+ * @brief Closes a session's socket and marks it done.
+ * @param client Pointer to the client state.
+ * @param session Session to finish.
+ * @param reason Readable reason, shown as the last response.
+ */
+void finish_session(Client *client, Session *session, const char *reason);
+
+/**
+ * @brief Formats a session as one row of the session table.
+ * @param session Session to describe.
+ * @param selected Whether typed lines go to this session.
+ * @param buffer Destination buffer.
+ * @param size Size of the destination buffer.
+ */
+void format_session(const Session *session, bool selected, char *buffer,
+                    size_t size);
+
+/**
+ * @brief Rewrites the screen rows whose text changed since the last redraw.
+ * @param client Pointer to the client state.
+ */
+void display_game_state(Client *client);
 
 /**
  * @brief Main loop for the game, handling input, output, and communication with
- * the server.
- * @param sock Socket descriptor connected to the server.
- * @param attempts Number of attempts given to guess the number.
- * @param min Minimum value in the number range.
- * @param max Maximum value in the number range.
- * @param name User's name.
+ * the server for all sessions.
+ * @param client Pointer to the client state.
  */
-void game_loop(int sock, int attempts, int min, int max, char *name[]);
+void game_loop(Client *client);
 
 /**
  * @brief Main function for the client application.
@@ -77,99 +325,156 @@ void game_loop(int sock, int attempts, int min, int max, char *name[]);
  * @return 0 on normal exit, or -1 on error.
  */
 int main(int argc, char *argv[]) {
-  int sock = 0;
-  struct sockaddr_in serv_addr;
-  char buffer[BUFFER_SIZE] = {0};
-
-  char *host = NULL;
-  int port = 0;
-  char *name = NULL;
-
-  if (!parse_and_validate_args(argc, argv, &host, &port, &name)) {
-    return -1;
-  }
-
-  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-    printf("\n Socket creation error \n");
+  Options options;
+  if (!parse_and_validate_args(argc, argv, &options)) {
     return -1;
   }
 
+  struct sockaddr_in serv_addr;
+  memset(&serv_addr, 0, sizeof(serv_addr));
   serv_addr.sin_family = AF_INET;
-  serv_addr.sin_port = htons(port);
-
-  if (inet_pton(AF_INET, host, &serv_addr.sin_addr) <= 0) {
+  serv_addr.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.host, &serv_addr.sin_addr) <= 0) {
     printf("\nInvalid address/ Address not supported \n");
     return -1;
   }
 
-  if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-    printf("\nConnection Failed \n");
+  Client client;
+  memset(&client, 0, sizeof(client));
+  client.mode = options.mode;
+  client.stdin_open = options.mode == INPUT_INTERACTIVE;
+  client.tty = isatty(STDOUT_FILENO);
+  if (options.script != NULL && !load_script(&client, options.script)) {
     return -1;
   }
 
-  send(sock, name, strlen(name) + 1, 0);
-  int valread = recv(sock, buffer, BUFFER_SIZE, 0);
-  int min, max, attempts;
-  if (valread == 0) {
-    printf("Server disconnected\n");
+  client.count = options.sessions;
+  client.sessions = (Session *)calloc(client.count, sizeof(Session));
+  if (client.sessions == NULL) {
+    printf("Out of memory\n");
     return -1;
-  } else if (buffer[0] == 'h') {
-    if (sscanf(buffer, "h %d %d %d", &min, &max, &attempts) != 3) {
-      printf("Server error\n");
-      return -1;
+  }
+  for (int i = 0; i < client.count; i++) {
+    Session *session = &client.sessions[i];
+    if (client.count == 1) {
+      snprintf(session->name, sizeof(session->name), "%s", options.name);
+    } else {
+      snprintf(session->name, sizeof(session->name), "%s-%d", options.name,
+               i + 1);
+    }
+    start_session(session, &serv_addr);
+    if (session->state == SESSION_DONE) {
+      client.dirty = true;
+      if (!client.tty) {
+        printf("%s: %s\n", session->name, session->last_response);
+      }
+    } else {
+      client.active++;
     }
-  } else if (buffer[0] == 'u') {
-    printf("Name already exists\n");
-    return -1;
   }
 
-  game_loop(sock, attempts, min, max, &name);
+  if (client.stdin_open) {
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+  }
+  if (client.tty) {
+    struct winsize size;
+    client.rows = 24;
+    client.columns = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0) {
+      client.rows = size.ws_row;
+      client.columns = size.ws_col;
+    }
+    client.shown = (char **)calloc(client.rows, sizeof(char *));
+    printf("\033[2J");
+  }
+
+  game_loop(&client);
+
+  int won = 0, lost = 0;
+  for (int i = 0; i < client.count; i++) {
+    won += client.sessions[i].result == RESP_VICTORY;
+    lost += client.sessions[i].result == RESP_DEFEAT;
+  }
+  if (client.tty) {
+    printf("\033[%d;1H\n", client.rows);
+  }
+  printf("Sessions: %d, won: %d, lost: %d, other: %d\n", client.count, won,
+         lost, client.count - won - lost);
 
-  close(sock);
+  for (int i = 0; client.shown != NULL && i < client.rows; i++) {
+    free(client.shown[i]);
+  }
+  free(client.shown);
+  for (int i = 0; i < client.script_lines; i++) {
+    free(client.script[i]);
+  }
+  free(client.script);
+  free(client.sessions);
   return 0;
 }
 
-bool parse_and_validate_args(int argc, char *argv[], char **host, int *port,
-                             char **name) {
+bool parse_and_validate_args(int argc, char *argv[], Options *options) {
+  options->host = NULL;
+  options->port = 0;
+  options->name = NULL;
+  options->sessions = 1;
+  options->script = NULL;
+  options->mode = INPUT_INTERACTIVE;
   for (int i = 1; i < argc; i++) {
-    if (strcmp(argv[i], "-h") == 0) {
-      *host = argv[i + 1];
-    } else if (strcmp(argv[i], "-p") == 0) {
-      *port = atoi(argv[i + 1]);
-    } else if (strcmp(argv[i], "-n") == 0) {
-      *name = argv[i + 1];
+    if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+      options->host = argv[++i];
+    } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      options->port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      options->name = argv[++i];
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      options->sessions = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      options->script = argv[++i];
+      options->mode = INPUT_SCRIPT;
+    } else if (strcmp(argv[i], "-a") == 0) {
+      options->mode = INPUT_SOLVER;
     }
   }
 
-  if (*host == NULL) *host = "127.0.0.1";
-  if (*port == 0) *port = PORT;
-  if (*name == NULL) {
-    printf("Usage: %s -h <host> -p <port> -n <name>\n", argv[0]);
+  if (options->host == NULL) options->host = "127.0.0.1";
+  if (options->port == 0) options->port = PORT;
+  if (options->name == NULL) {
+    printf("Usage: %s -h <host> -p <port> -n <name> [-c <sessions>] "
+           "[-s <script> | -a]\n",
+           argv[0]);
     return false;
   }
-  if (*port < 1024 || *port > 65535) {
+  if (options->port < 1024 || options->port > 65535) {
     printf("Port must be in range 1024-65535\n");
     return false;
   }
-  if (strlen(*name) > 255) {
+  if (strlen(options->name) > 255 ||
+      (options->sessions > 1 && strlen(options->name) > 240)) {
     printf("Name must be less than 255 characters\n");
     return false;
   }
+  if (options->sessions < 1) {
+    printf("Number of sessions must be positive\n");
+    return false;
+  }
 
   return true;
 }
 
 char *parse_client_input(const char *input) {
   static char command[100];
-  int number;
+  int number = 0;
   char checkChar;
 
   if (sscanf(input, "greater than %d%c", &number, &checkChar) == 1) {
-    sprintf(command, "g %d", number);
+    protocolFormatQuestion(command, sizeof(command), CMD_GREATER, number);
   } else if (sscanf(input, "less than %d%c", &number, &checkChar) == 1) {
-    sprintf(command, "l %d", number);
+    protocolFormatQuestion(command, sizeof(command), CMD_LESS, number);
   } else if (sscanf(input, "equal %d%c", &number, &checkChar) == 1) {
-    sprintf(command, "e %d", number);
+    protocolFormatQuestion(command, sizeof(command), CMD_EQUAL, number);
+  } else if (sscanf(input, "leaderboard %d%c", &number, &checkChar) == 1) {
+    protocolFormatQuestion(command, sizeof(command), CMD_LEADERBOARD, number);
   } else if (strcmp(input, "exit") == 0) {
     strcpy(command, "exit");
   } else {
@@ -183,80 +488,448 @@ char *parse_client_input(const char *input) {
 
 char *parse_server_response(char response) {
   switch (response) {
-    case 'c':
+    case RESP_CORRECT:
       return "Correct guess.";
-    case 'i':
+    case RESP_INCORRECT:
       return "Incorrect guess.";
-    case 'v':
+    case RESP_VICTORY:
       return "Victory!";
-    case 'd':
+    case RESP_DEFEAT:
       return "Defeat.";
-    case 'f':
+    case RESP_FORMAT:
       return "Incorrect question format.";
-    case 'q':
+    case RESP_QUESTION:
       return "Invalid question.";
-    case 'o':
+    case RESP_NO_ATTEMPTS:
       return "Out of attempts.";
+    case RESP_TIMEOUT:
+      return "Session timed out.";
     default:
       return "Unknown response.";
   }
 }
 
-void display_game_state(const char *username, int attempts, int min, int max,
-                        const char *last_input, const char *last_response) {
-  printf("\033[2J\033[H");
-  printf("\033[1;31mWelcome to the number guessing game!\033[0m\n");
-  printf("\033[1;30mCommands:\033[0m\n");
-  printf("\033[1;30mgreater than <positive integer>\033[0m\n");
-  printf("\033[1;30mlower than <positive integer>\033[0m\n");
-  printf("\033[1;30mequal <positive integer>\033[0m\n");
-  printf("\033[1;34mUsername: %.10s\033[0m\n", username);
-  printf("\033[1;32mAttempts remaining: %3d\033[0m\n", attempts);
-  printf("\033[1;35mRange: %d - %d\033[0m\n", min, max);
-  printf("\033[1;33mLast Input: %s\033[0m\n", last_input);
-  printf("\033[1;33mLast Server Response: %s\033[0m\n", last_response);
-  printf("\033[1;33m----------------------------------------\033[0m\n");
-  printf("\033[1;36mEnter your guess or command: \033[0m");
+bool load_script(Client *client, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    printf("Script %s not found\n", path);
+    return false;
+  }
+  char line[BUFFER_SIZE];
+  int capacity = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+    if (client->script_lines == capacity) {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+      char **grown =
+          (char **)realloc(client->script, capacity * sizeof(char *));
+      if (grown == NULL) {
+        fclose(file);
+        return false;
+      }
+      client->script = grown;
+    }
+    client->script[client->script_lines++] = strdup(line);
+  }
+  fclose(file);
+  return true;
 }
 
-void game_loop(int sock, int attempts, int min, int max, char *name[]) {
-  char buffer[BUFFER_SIZE];
-  char input[BUFFER_SIZE];
-  char last_input[BUFFER_SIZE] = "";
-  char last_response[BUFFER_SIZE] = "";
-
-  while (true) {
-    display_game_state(*name, attempts, min, max, last_input, last_response);
-    fgets(input, BUFFER_SIZE, stdin);
-    input[strcspn(input, "\n")] = 0;
-    char *parsed_input = parse_client_input(input);
-    if (strcmp(parsed_input, "exit") == 0) {
+void start_session(Session *session, const struct sockaddr_in *address) {
+  session->state = SESSION_CONNECTING;
+  session->sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (session->sock < 0) {
+    session->state = SESSION_DONE;
+    strcpy(session->last_response, "Socket creation error");
+    return;
+  }
+  fcntl(session->sock, F_SETFL, O_NONBLOCK);
+  if (connect(session->sock, (const struct sockaddr *)address,
+              sizeof(*address)) < 0 &&
+      errno != EINPROGRESS) {
+    close(session->sock);
+    session->sock = -1;
+    session->state = SESSION_DONE;
+    strcpy(session->last_response, "Connection Failed");
+    return;
+  }
+  size_t length = strlen(session->name) + 1;
+  memcpy(session->output, session->name, length);
+  session->output_length = length;
+  strcpy(session->last_response, "Connecting");
+}
+
+void flush_output(Client *client, Session *session) {
+  ssize_t sent = send(session->sock, session->output, session->output_length,
+                      MSG_NOSIGNAL);
+  if (sent < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      finish_session(client, session, "Server disconnected");
+    }
+    return;
+  }
+  session->output_length -= sent;
+  memmove(session->output, session->output + sent, session->output_length);
+}
+
+void handle_session_event(Client *client, Session *session, short revents) {
+  if (session->state == SESSION_CONNECTING) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(session->sock, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0) {
+      finish_session(client, session, "Connection Failed");
+      return;
+    }
+    session->state = SESSION_HELLO;
+  }
+  if ((revents & POLLOUT) && session->output_length > 0) {
+    flush_output(client, session);
+  }
+  if (session->state != SESSION_DONE &&
+      (revents & (POLLIN | POLLHUP | POLLERR))) {
+    char buffer[BUFFER_SIZE];
+    ssize_t valread = recv(session->sock, buffer, BUFFER_SIZE - 1, 0);
+    if (valread > 0) {
+      buffer[valread] = '\0';
+      handle_response(client, session, buffer);
+    } else if (valread == 0 ||
+               (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      finish_session(client, session, "Server disconnected");
+    }
+  }
+}
+
+void handle_response(Client *client, Session *session, const char *message) {
+  client->dirty = true;
+  if (session->state == SESSION_HELLO) {
+    if (message[0] == RESP_NAME_TAKEN) {
+      finish_session(client, session, "Name already exists");
+    } else if (protocolParseHello(message, &session->min, &session->max,
+                                  &session->attempts) == -1) {
+      finish_session(client, session, "Server error");
+    } else {
+      session->low = session->min;
+      session->high = session->max;
+      session->state = SESSION_READY;
+      strcpy(session->last_response, "Game started");
+    }
+    return;
+  }
+
+  char response = message[0];
+  if (response == RESP_LEADERBOARD) {
+    // Show the table on one line: "r <rank> <players> | <player> | ..."
+    snprintf(session->last_response, sizeof(session->last_response), "%s",
+             message);
+    for (char *c = session->last_response; *c != '\0'; c++) {
+      if (*c == '\n') {
+        *c = c[1] == '\0' ? '\0' : '|';
+      }
+    }
+  } else {
+    strcpy(session->last_response, parse_server_response(response));
+  }
+  if (protocolUsesAttempt(response)) {
+    session->attempts--;
+    session->questions++;
+    // The solver only asks "greater than"
+    if (client->mode == INPUT_SOLVER && response == RESP_CORRECT) {
+      session->low = session->asked + 1;
+    } else if (client->mode == INPUT_SOLVER) {
+      session->high = session->asked;
+    }
+  } else if (response == RESP_NO_ATTEMPTS) {
+    session->attempts = 0;
+  }
+
+  if (!client->tty) {
+    printf("%s: %s -> %s\n", session->name, session->last_input,
+           session->last_response);
+  }
+  if (protocolIsFinal(response)) {
+    session->result = response;
+    finish_session(client, session, session->last_response);
+  } else {
+    session->state = SESSION_READY;
+  }
+}
+
+void play_next_move(Client *client, Session *session) {
+  if (client->mode == INPUT_SOLVER) {
+    char input[INPUT_SIZE];
+    if (session->low < session->high && session->attempts > 0) {
+      session->asked = session->low + (session->high - session->low) / 2;
+      snprintf(input, sizeof(input), "greater than %d", session->asked);
+    } else {
+      snprintf(input, sizeof(input), "equal %d", session->low);
+    }
+    play_input(client, session, input);
+    return;
+  }
+  while (session->state == SESSION_READY) {
+    if (session->script_line == client->script_lines) {
+      finish_session(client, session, "Script ended");
+      return;
+    }
+    play_input(client, session, client->script[session->script_line++]);
+  }
+}
+
+void play_input(Client *client, Session *session, const char *input) {
+  client->dirty = true;
+  snprintf(session->last_input, sizeof(session->last_input), "%s", input);
+  char *parsed_input = parse_client_input(input);
+  if (strcmp(parsed_input, "exit") == 0) {
+    finish_session(client, session, "Exit");
+    return;
+  }
+  if (strcmp(parsed_input, "i") == 0) {
+    strcpy(session->last_response, "Invalid input");
+    return;
+  }
+  size_t length = strlen(parsed_input);
+  memcpy(session->output, parsed_input, length);
+  session->output_length = length;
+  session->state = SESSION_WAITING;
+  flush_output(client, session);
+}
+
+void read_terminal(Client *client) {
+  ssize_t valread = read(STDIN_FILENO, client->input + client->input_length,
+                         sizeof(client->input) - 1 - client->input_length);
+  if (valread > 0) {
+    client->input_length += valread;
+  } else if (valread == 0 || (errno != EAGAIN && errno != EINTR)) {
+    client->stdin_open = false;
+  }
+  play_typed_lines(client);
+}
+
+void play_typed_lines(Client *client) {
+  char *line = client->input;
+  char *end;
+  while ((end = memchr(line, '\n',
+                       client->input + client->input_length - line)) != NULL) {
+    Session *session = &client->sessions[client->current];
+    if (line[0] != '@' && session->state != SESSION_READY &&
+        session->state != SESSION_DONE) {
       break;
     }
+    *end = '\0';
+    client->dirty = true;
+    if (line[0] == '@') {
+      int selected = atoi(line + 1);
+      if (selected >= 1 && selected <= client->count) {
+        client->current = selected - 1;
+      }
+    } else if (session->state == SESSION_READY) {
+      play_input(client, session, line);
+    }
+    line = end + 1;
+  }
+  client->input_length -= line - client->input;
+  memmove(client->input, line, client->input_length);
+  // A line longer than the buffer is dropped
+  if (client->input_length == sizeof(client->input) - 1 &&
+      memchr(client->input, '\n', client->input_length) == NULL) {
+    client->input_length = 0;
+  }
+
+  // End of input ends every session once its lines are played, like typing
+  // "exit" in each. Sessions still connecting or waiting for a response are
+  // ended by a later call, once the response has arrived.
+  if (!client->stdin_open &&
+      memchr(client->input, '\n', client->input_length) == NULL) {
+    for (int i = 0; i < client->count; i++) {
+      if (client->sessions[i].state == SESSION_READY) {
+        finish_session(client, &client->sessions[i], "Exit");
+      }
+    }
+  }
+}
+
+void finish_session(Client *client, Session *session, const char *reason) {
+  if (session->sock >= 0) {
+    close(session->sock);
+    session->sock = -1;
+  }
+  if (session->state == SESSION_DONE) {
+    return;
+  }
+  session->state = SESSION_DONE;
+  session->output_length = 0;
+  if (reason != session->last_response) {
+    snprintf(session->last_response, sizeof(session->last_response), "%s",
+             reason);
+  }
+  client->active--;
+  client->dirty = true;
+  if (!client->tty && session->result == 0) {
+    printf("%s: %s\n", session->name, session->last_response);
+  }
+}
+
+void format_session(const Session *session, bool selected, char *buffer,
+                    size_t size) {
+  char range[32];
+  snprintf(range, sizeof(range), "%d - %d", session->min, session->max);
+  snprintf(buffer, size, "%c %-16.16s %3d  %-13s %-18.18s %s",
+           selected ? '>' : ' ', session->name, session->attempts, range,
+           session->last_input, session->last_response);
+}
+
+void display_game_state(Client *client) {
+  int table_rows = client->rows - HEADER_ROWS - FOOTER_ROWS;
+  if (table_rows < 1) {
+    table_rows = 1;
+  }
+  // Scroll the table so that the selected session stays visible
+  int first = 0;
+  if (client->current >= table_rows) {
+    first = client->current - table_rows + 1;
+  }
+
+  int playing = 0, won = 0, lost = 0;
+  for (int i = 0; i < client->count; i++) {
+    playing += client->sessions[i].state != SESSION_DONE;
+    won += client->sessions[i].result == RESP_VICTORY;
+    lost += client->sessions[i].result == RESP_DEFEAT;
+  }
+
+  char *text = (char *)malloc(client->columns + 1);
+  if (text == NULL) {
+    return;
+  }
+  for (int row = 0; row < client->rows - 1; row++) {
+    int index = first + row - HEADER_ROWS;
+    const char *color = "";
+    if (row == 0) {
+      color = "\033[1;31m";
+      snprintf(text, client->columns + 1,
+               "Welcome to the number guessing game!");
+    } else if (row == 1) {
+      color = "\033[1;30m";
+      snprintf(text, client->columns + 1,
+               client->mode == INPUT_INTERACTIVE
+                   ? "greater than <n> | less than <n> | equal <n> | "
+                     "leaderboard <n> | @<session> | exit"
+                   : client->mode == INPUT_SCRIPT ? "Playing the script"
+                                                  : "Solving");
+    } else if (row == 2) {
+      color = "\033[1;32m";
+      snprintf(text, client->columns + 1,
+               "Sessions: %d, playing: %d, won: %d, lost: %d", client->count,
+               playing, won, lost);
+    } else if (row == 3) {
+      color = "\033[1;33m";
+      snprintf(text, client->columns + 1, "  %-16s %3s  %-13s %-18s %s",
+               "Username", "Att", "Range", "Last Input",
+               "Last Server Response");
+    } else if (row < HEADER_ROWS + table_rows && index < client->count) {
+      format_session(&client->sessions[index], client->mode ==
+                         INPUT_INTERACTIVE && index == client->current,
+                     text, client->columns + 1);
+    } else if (row == client->rows - FOOTER_ROWS &&
+               client->count > table_rows) {
+      snprintf(text, client->columns + 1, "  (%d more sessions)",
+               client->count - table_rows);
+    } else {
+      text[0] = '\0';
+    }
 
-    strcpy(last_input, input);
-    if (strcmp(parsed_input, "i") == 0) {
-      sprintf(last_response, "Invalid input");
+    if (client->shown[row] != NULL && strcmp(client->shown[row], text) == 0) {
       continue;
     }
+    printf("\033[%d;1H%s%s\033[0m\033[K", row + 1, color, text);
+    free(client->shown[row]);
+    client->shown[row] = strdup(text);
+  }
+  free(text);
+
+  if (client->stdin_open) {
+    printf("\033[%d;1H\033[1;36mEnter your guess or command: \033[0m\033[K",
+           client->rows);
+  }
+  fflush(stdout);
+}
 
-    send(sock, parsed_input, strlen(parsed_input), 0);
+void game_loop(Client *client) {
+  struct pollfd *fds =
+      (struct pollfd *)calloc(client->count + 1, sizeof(struct pollfd));
+  Session **owners = (Session **)calloc(client->count + 1, sizeof(Session *));
+  if (fds == NULL || owners == NULL) {
+    printf("Out of memory\n");
+    free(fds);
+    free(owners);
+    return;
+  }
 
-    int valread = recv(sock, buffer, 1, 0);
-    if (valread == 0 || valread == -1) {
-      printf("Server disconnected\n");
+  while (client->active > 0) {
+    if (client->mode != INPUT_INTERACTIVE) {
+      for (int i = 0; i < client->count; i++) {
+        if (client->sessions[i].state == SESSION_READY) {
+          play_next_move(client, &client->sessions[i]);
+        }
+      }
+    }
+    if (client->tty && client->dirty) {
+      display_game_state(client);
+      client->dirty = false;
+    }
+    if (client->active == 0) {
       break;
     }
-    if (buffer[0] == 'c' || buffer[0] == 'i') {
-      attempts--;
+
+    int nfds = 0;
+    if (client->stdin_open &&
+        client->input_length < sizeof(client->input) - 1) {
+      fds[nfds].fd = STDIN_FILENO;
+      fds[nfds].events = POLLIN;
+      owners[nfds++] = NULL;
+    }
+    for (int i = 0; i < client->count; i++) {
+      Session *session = &client->sessions[i];
+      if (session->state == SESSION_DONE) {
+        continue;
+      }
+      fds[nfds].fd = session->sock;
+      fds[nfds].events = session->state == SESSION_CONNECTING ||
+                                 session->output_length > 0
+                             ? POLLOUT
+                             : POLLIN;
+      owners[nfds++] = session;
     }
-    strcpy(last_response, parse_server_response(buffer[0]));
 
-    if (strncmp(buffer, "v", 1) == 0 || strncmp(buffer, "d", 1) == 0) {
-      printf("%s\n", parse_server_response(buffer[0]));
+    if (poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
       break;
     }
+    for (int i = 0; i < nfds; i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      if (owners[i] == NULL) {
+        read_terminal(client);
+      } else if (owners[i]->state != SESSION_DONE) {
+        handle_session_event(client, owners[i], fds[i].revents);
+      }
+    }
+    if (client->mode == INPUT_INTERACTIVE) {
+      play_typed_lines(client);
+    }
+  }
+  if (client->tty && client->dirty) {
+    display_game_state(client);
   }
+  free(fds);
+  free(owners);
 }
 
 // 1. Клиент отправляет имя
@@ -267,7 +940,13 @@ void game_loop(int sock, int attempts, int min, int max, char *name[]) {
 // Каждые 10 запросов показывать пользователю условие, количество попыток
 // 5. Отправка диапазона клиенту
 // Запуск клиента - ./client -h <host> -p <port> -n <name>
+//                  ./client -n bot -c 300 -a (300 игроков с автоматическим
+//                  решением) или -s script.txt (ходы из файла)
 // Запуск сервера - ./server conffile.txt
+// Сборка: gcc client.c protocol.c -o client
+//         gcc server.c timerwheel.c rng.c metrics.c shmring.c leaderboard.c
+//             wal.c -lpthread -o server
+//         gcc loadgen.c protocol.c hdrhist.c shmring.c -lpthread -o loadgen
 
 // ./a.out
 
@@ -281,4 +960,4 @@ void game_loop(int sock, int attempts, int min, int max, char *name[]) {
 // 55
 
 // 1000
-// 5000
\ No newline at end of file
+// 5000
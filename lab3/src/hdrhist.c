@@ -0,0 +1,86 @@
+/**
+ * @file hdrhist.c
+ * @brief Implementation of the log-linear latency histogram.
+ */
+#include "hdrhist.h"
+
+#include <string.h>
+
+#define HDR_HALF (HDR_SUB_BUCKETS / 2)
+
+static int bucketIndex(uint64_t value) {
+  if (value < HDR_SUB_BUCKETS) {
+    return (int)value;
+  }
+  int shift = 63 - __builtin_clzll(value) - (HDR_SUB_BITS - 1);
+  if (shift > HDR_MAX_SHIFT) {
+    return HDR_BUCKETS - 1;
+  }
+  return shift * HDR_HALF + (int)(value >> shift);
+}
+
+static uint64_t bucketHighest(int index) {
+  if (index < HDR_SUB_BUCKETS) {
+    return (uint64_t)index;
+  }
+  int shift = index / HDR_HALF - 1;
+  uint64_t sub = (uint64_t)(index - shift * HDR_HALF);
+  return ((sub + 1) << shift) - 1;
+}
+
+void hdrInit(HdrHist *h) {
+  memset(h, 0, sizeof(*h));
+  h->min = UINT64_MAX;
+}
+
+void hdrRecord(HdrHist *h, uint64_t value) {
+  h->counts[bucketIndex(value)]++;
+  h->total++;
+  h->sum += value;
+  if (value < h->min) {
+    h->min = value;
+  }
+  if (value > h->max) {
+    h->max = value;
+  }
+}
+
+void hdrMerge(HdrHist *dst, const HdrHist *src) {
+  for (int i = 0; i < HDR_BUCKETS; i++) {
+    dst->counts[i] += src->counts[i];
+  }
+  dst->total += src->total;
+  dst->sum += src->sum;
+  if (src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+}
+
+uint64_t hdrPercentile(const HdrHist *h, double percentile) {
+  if (h->total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > h->total) {
+    rank = h->total;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < HDR_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t value = bucketHighest(i);
+      return value < h->max ? value : h->max;
+    }
+  }
+  return h->max;
+}
+
+double hdrMean(const HdrHist *h) {
+  return h->total == 0 ? 0.0 : (double)h->sum / (double)h->total;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file hdrhist.h
+ * @brief Log-linear latency histogram in the spirit of HdrHistogram.
+ *
+ * Values below HDR_SUB_BUCKETS are counted exactly; above that every power of
+ * two is split into HDR_SUB_BUCKETS / 2 linear sub-buckets, which bounds the
+ * relative error of reported percentiles by 2 / HDR_SUB_BUCKETS (under 1%).
+ * Recording is a couple of bit operations and one increment, and histograms
+ * of different threads can be merged by adding their counts.
+ */
+#ifndef HDRHIST_H
+#define HDRHIST_H
+
+#include <stdint.h>
+
+#define HDR_SUB_BITS 8
+#define HDR_SUB_BUCKETS (1 << HDR_SUB_BITS)
+#define HDR_MAX_SHIFT 40
+#define HDR_BUCKETS ((HDR_MAX_SHIFT + 2) * (HDR_SUB_BUCKETS / 2))
+
+/**
+ * @struct HdrHist
+ * @brief Histogram counts and summary values.
+ *
+ * @var HdrHist::counts
+ * Number of recorded values per bucket.
+ * @var HdrHist::total
+ * Number of recorded values.
+ * @var HdrHist::sum
+ * Sum of recorded values, used for the mean.
+ * @var HdrHist::min
+ * Smallest recorded value.
+ * @var HdrHist::max
+ * Largest recorded value.
+ */
+typedef struct {
+  uint64_t counts[HDR_BUCKETS];
+  uint64_t total;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+} HdrHist;
+
+/**
+ * @brief Resets a histogram to the empty state.
+ * @param h Histogram to reset.
+ */
+void hdrInit(HdrHist *h);
+
+/**
+ * @brief Records one value.
+ * @param h Histogram to update.
+ * @param value Value to record, e.g. a latency in nanoseconds.
+ */
+void hdrRecord(HdrHist *h, uint64_t value);
+
+/**
+ * @brief Adds the counts of one histogram to another.
+ * @param dst Histogram receiving the counts.
+ * @param src Histogram to add.
+ */
+void hdrMerge(HdrHist *dst, const HdrHist *src);
+
+/**
+ * @brief Returns the value at a percentile.
+ * @param h Histogram to query.
+ * @param percentile Percentile in the range [0, 100].
+ * @return Highest value equivalent to the percentile's bucket, 0 if empty.
+ */
+uint64_t hdrPercentile(const HdrHist *h, double percentile);
+
+/**
+ * @brief Returns the mean of the recorded values.
+ * @param h Histogram to query.
+ * @return Mean value, 0 if empty.
+ */
+double hdrMean(const HdrHist *h);
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * @file leaderboard.c
+ * @brief Implementation of the player ranking.
+ */
+#include "leaderboard.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int height(const Leaderboard *board, int node) {
+  return node < 0 ? 0 : board->entries[node].height;
+}
+
+static int size(const Leaderboard *board, int node) {
+  return node < 0 ? 0 : board->entries[node].size;
+}
+
+/* Negative if entry a ranks before entry b. */
+static int compare(const Leaderboard *board, int a, int b) {
+  const LeaderboardEntry *x = &board->entries[a];
+  const LeaderboardEntry *y = &board->entries[b];
+  if (x->wins != y->wins) {
+    return x->wins > y->wins ? -1 : 1;
+  }
+  if (x->attemptsUsed != y->attemptsUsed) {
+    return x->attemptsUsed < y->attemptsUsed ? -1 : 1;
+  }
+  return strcmp(x->name, y->name);
+}
+
+static void update(Leaderboard *board, int node) {
+  LeaderboardEntry *entry = &board->entries[node];
+  int left = height(board, entry->left), right = height(board, entry->right);
+  entry->height = (left > right ? left : right) + 1;
+  entry->size = size(board, entry->left) + size(board, entry->right) + 1;
+}
+
+static int rotateRight(Leaderboard *board, int node) {
+  int pivot = board->entries[node].left;
+  board->entries[node].left = board->entries[pivot].right;
+  board->entries[pivot].right = node;
+  update(board, node);
+  update(board, pivot);
+  return pivot;
+}
+
+static int rotateLeft(Leaderboard *board, int node) {
+  int pivot = board->entries[node].right;
+  board->entries[node].right = board->entries[pivot].left;
+  board->entries[pivot].left = node;
+  update(board, node);
+  update(board, pivot);
+  return pivot;
+}
+
+static int balance(Leaderboard *board, int node) {
+  LeaderboardEntry *entry = &board->entries[node];
+  update(board, node);
+  int factor = height(board, entry->left) - height(board, entry->right);
+  if (factor > 1) {
+    const LeaderboardEntry *left = &board->entries[entry->left];
+    if (height(board, left->left) < height(board, left->right)) {
+      entry->left = rotateLeft(board, entry->left);
+    }
+    return rotateRight(board, node);
+  }
+  if (factor < -1) {
+    const LeaderboardEntry *right = &board->entries[entry->right];
+    if (height(board, right->right) < height(board, right->left)) {
+      entry->right = rotateRight(board, entry->right);
+    }
+    return rotateLeft(board, node);
+  }
+  return node;
+}
+
+static int insert(Leaderboard *board, int root, int node) {
+  if (root < 0) {
+    LeaderboardEntry *entry = &board->entries[node];
+    entry->left = entry->right = -1;
+    entry->height = entry->size = 1;
+    return node;
+  }
+  if (compare(board, node, root) < 0) {
+    board->entries[root].left = insert(board, board->entries[root].left, node);
+  } else {
+    board->entries[root].right =
+        insert(board, board->entries[root].right, node);
+  }
+  return balance(board, root);
+}
+
+static int removeMin(Leaderboard *board, int root, int *min) {
+  if (board->entries[root].left < 0) {
+    *min = root;
+    return board->entries[root].right;
+  }
+  board->entries[root].left =
+      removeMin(board, board->entries[root].left, min);
+  return balance(board, root);
+}
+
+static int removeNode(Leaderboard *board, int root, int node) {
+  LeaderboardEntry *entry = &board->entries[root];
+  if (root != node) {
+    if (compare(board, node, root) < 0) {
+      entry->left = removeNode(board, entry->left, node);
+    } else {
+      entry->right = removeNode(board, entry->right, node);
+    }
+    return balance(board, root);
+  }
+  if (entry->left < 0 || entry->right < 0) {
+    return entry->left < 0 ? entry->right : entry->left;
+  }
+  int min;
+  int right = removeMin(board, entry->right, &min);
+  board->entries[min].left = entry->left;
+  board->entries[min].right = right;
+  return balance(board, min);
+}
+
+static uint32_t hashName(const char *name) {
+  uint32_t hash = 2166136261u;
+  for (; *name != '\0'; name++) {
+    hash = (hash ^ (unsigned char)*name) * 16777619u;
+  }
+  return hash;
+}
+
+/* Slot of the name in the hash index: the one holding it or the empty one
+ * where it would go. */
+static int findSlot(const Leaderboard *board, const char *name) {
+  uint32_t mask = board->indexSize - 1;
+  uint32_t slot = hashName(name) & mask;
+  while (board->index[slot] >= 0 &&
+         strcmp(board->entries[board->index[slot]].name, name) != 0) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static int growIndex(Leaderboard *board) {
+  int oldSize = board->indexSize;
+  int *old = board->index;
+  int newSize = oldSize == 0 ? 64 : oldSize * 2;
+  int *index = (int *)malloc(newSize * sizeof(int));
+  if (index == NULL) {
+    return -1;
+  }
+  memset(index, 0xff, newSize * sizeof(int));
+  board->index = index;
+  board->indexSize = newSize;
+  for (int i = 0; i < oldSize; i++) {
+    if (old[i] >= 0) {
+      board->index[findSlot(board, board->entries[old[i]].name)] = old[i];
+    }
+  }
+  free(old);
+  return 0;
+}
+
+/* Returns the entry of the name, taken out of the tree so that its record can
+ * change, or -1 if out of memory. */
+static int detach(Leaderboard *board, const char *name) {
+  if ((board->count + 1) * 2 > board->indexSize && growIndex(board) == -1) {
+    return -1;
+  }
+  int slot = findSlot(board, name);
+  int node = board->index[slot];
+  if (node >= 0) {
+    board->root = removeNode(board, board->root, node);
+    return node;
+  }
+
+  if (board->count == board->capacity) {
+    int capacity = board->capacity == 0 ? 64 : board->capacity * 2;
+    LeaderboardEntry *entries = (LeaderboardEntry *)realloc(
+        board->entries, capacity * sizeof(LeaderboardEntry));
+    if (entries == NULL) {
+      return -1;
+    }
+    board->entries = entries;
+    board->capacity = capacity;
+  }
+  node = board->count;
+  LeaderboardEntry *entry = &board->entries[node];
+  memset(entry, 0, sizeof(*entry));
+  entry->name = strdup(name);
+  if (entry->name == NULL) {
+    return -1;
+  }
+  board->count++;
+  board->index[slot] = node;
+  return node;
+}
+
+void leaderboardInit(Leaderboard *board) {
+  memset(board, 0, sizeof(*board));
+  board->root = -1;
+}
+
+void leaderboardDestroy(Leaderboard *board) {
+  for (int i = 0; i < board->count; i++) {
+    free(board->entries[i].name);
+  }
+  free(board->entries);
+  free(board->index);
+  leaderboardInit(board);
+}
+
+int leaderboardRecord(Leaderboard *board, const char *name, int won,
+                      uint64_t attemptsUsed) {
+  int node = detach(board, name);
+  if (node == -1) {
+    return -1;
+  }
+  LeaderboardEntry *entry = &board->entries[node];
+  entry->wins += won ? 1 : 0;
+  entry->games++;
+  entry->attemptsUsed += attemptsUsed;
+  board->root = insert(board, board->root, node);
+  return 0;
+}
+
+int leaderboardSet(Leaderboard *board, const char *name, uint32_t wins,
+                   uint32_t games, uint64_t attemptsUsed) {
+  int node = detach(board, name);
+  if (node == -1) {
+    return -1;
+  }
+  LeaderboardEntry *entry = &board->entries[node];
+  entry->wins = wins;
+  entry->games = games;
+  entry->attemptsUsed = attemptsUsed;
+  board->root = insert(board, board->root, node);
+  return 0;
+}
+
+int leaderboardRank(const Leaderboard *board, const char *name) {
+  if (board->count == 0) {
+    return 0;
+  }
+  int node = board->index[findSlot(board, name)];
+  if (node < 0) {
+    return 0;
+  }
+  int rank = 0;
+  for (int i = board->root; i != node;) {
+    if (compare(board, node, i) < 0) {
+      i = board->entries[i].left;
+    } else {
+      rank += size(board, board->entries[i].left) + 1;
+      i = board->entries[i].right;
+    }
+  }
+  return rank + size(board, board->entries[node].left) + 1;
+}
+
+const LeaderboardEntry *leaderboardAt(const Leaderboard *board, int rank) {
+  if (rank < 1 || rank > board->count) {
+    return NULL;
+  }
+  int node = board->root;
+  while (1) {
+    int before = size(board, board->entries[node].left);
+    if (rank <= before) {
+      node = board->entries[node].left;
+    } else if (rank == before + 1) {
+      return &board->entries[node];
+    } else {
+      rank -= before + 1;
+      node = board->entries[node].right;
+    }
+  }
+}
@@ -0,0 +1,127 @@
+/**
+ * @file leaderboard.h
+ * @brief Ranking of all players by their finished games.
+ *
+ * Players are ranked by wins, fewer attempts used breaking ties and the name
+ * deciding between equal records. Entries are kept in an AVL tree whose nodes
+ * also count their subtree, so updating a player, finding a player's rank and
+ * finding the player at a rank all take O(log n). A hash index maps names to
+ * entries. Nodes live in one array and are linked by index, like the timer
+ * wheel's pool.
+ */
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stdint.h>
+
+/**
+ * @struct LeaderboardEntry
+ * @brief Record of one player and its tree node.
+ *
+ * @var LeaderboardEntry::name
+ * Player name, owned by the entry.
+ * @var LeaderboardEntry::wins
+ * Games won.
+ * @var LeaderboardEntry::games
+ * Games finished in any way.
+ * @var LeaderboardEntry::attemptsUsed
+ * Questions and guesses over all finished games.
+ * @var LeaderboardEntry::left
+ * Index of the left child, -1 if none.
+ * @var LeaderboardEntry::right
+ * Index of the right child, -1 if none.
+ * @var LeaderboardEntry::height
+ * Height of the subtree.
+ * @var LeaderboardEntry::size
+ * Number of nodes in the subtree.
+ */
+typedef struct {
+  char *name;
+  uint32_t wins;
+  uint32_t games;
+  uint64_t attemptsUsed;
+  int left;
+  int right;
+  int height;
+  int size;
+} LeaderboardEntry;
+
+/**
+ * @struct Leaderboard
+ * @brief The tree, its node array and the name index.
+ *
+ * @var Leaderboard::entries
+ * Node array.
+ * @var Leaderboard::count
+ * Number of players.
+ * @var Leaderboard::capacity
+ * Capacity of the node array.
+ * @var Leaderboard::root
+ * Index of the root node, -1 if the board is empty.
+ * @var Leaderboard::index
+ * Open-addressing hash table of entry indexes by name, -1 for empty slots.
+ * @var Leaderboard::indexSize
+ * Number of slots of the hash table, a power of two.
+ */
+typedef struct {
+  LeaderboardEntry *entries;
+  int count;
+  int capacity;
+  int root;
+  int *index;
+  int indexSize;
+} Leaderboard;
+
+/**
+ * @brief Initializes an empty leaderboard.
+ * @param board Leaderboard to initialize.
+ */
+void leaderboardInit(Leaderboard *board);
+
+/**
+ * @brief Frees all entries.
+ * @param board Leaderboard to destroy.
+ */
+void leaderboardDestroy(Leaderboard *board);
+
+/**
+ * @brief Adds a finished game to a player's record, creating the player if
+ * needed.
+ * @param board Leaderboard to update.
+ * @param name Player name.
+ * @param won Whether the game was won.
+ * @param attemptsUsed Questions and guesses of the game.
+ * @return 0 on success, -1 if out of memory.
+ */
+int leaderboardRecord(Leaderboard *board, const char *name, int won,
+                      uint64_t attemptsUsed);
+
+/**
+ * @brief Replaces a player's record, e.g. from a snapshot.
+ * @param board Leaderboard to update.
+ * @param name Player name.
+ * @param wins Games won.
+ * @param games Games finished.
+ * @param attemptsUsed Questions and guesses over all games.
+ * @return 0 on success, -1 if out of memory.
+ */
+int leaderboardSet(Leaderboard *board, const char *name, uint32_t wins,
+                   uint32_t games, uint64_t attemptsUsed);
+
+/**
+ * @brief Returns a player's rank.
+ * @param board Leaderboard to search.
+ * @param name Player name.
+ * @return 1 for the best player, 0 if the player has not finished a game.
+ */
+int leaderboardRank(const Leaderboard *board, const char *name);
+
+/**
+ * @brief Returns the player at a rank.
+ * @param board Leaderboard to search.
+ * @param rank Rank from 1 to the number of players.
+ * @return The entry, or NULL if rank is out of range.
+ */
+const LeaderboardEntry *leaderboardAt(const Leaderboard *board, int rank);
+
+#endif
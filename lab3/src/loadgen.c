@@ -0,0 +1,737 @@
+/**
+ * @file loadgen.c
+ * @brief Load generator for the "Guess the Number" server.
+ *
+ * The generator opens many non-blocking connections from a few threads, each
+ * thread driving its share of connections from one epoll loop. Every
+ * connection plays complete games with an optimal binary search over the
+ * received range and reconnects until it has played the requested number of
+ * games. Connect, handshake and request latencies are collected in log-linear
+ * histograms and reported together with connect and request rates.
+ *
+ * Player names are derived from the prefix, thread and connection numbers, and
+ * every game is played deterministically, so runs with the same options
+ * against a server with the same configuration are repeatable.
+ *
+ * With -u the games are played over the server's Unix socket instead of TCP,
+ * with -s over a shared-memory channel set up through that socket, so the
+ * same run can be repeated on every transport and the results compared.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdrhist.h"
+#include "protocol.h"
+#include "shmring.h"
+
+#define BUFFER_SIZE 256
+#define PORT 8080
+#define MAX_EVENTS 256
+#define NAME_SIZE 64
+
+/**
+ * @enum ConnState
+ * @brief Stage of a load generator connection.
+ */
+typedef enum {
+  CONN_CONNECTING, /**< Non-blocking connect in progress. */
+  CONN_HELLO,      /**< Name sent, waiting for the hello message. */
+  CONN_PLAYING,    /**< Question sent, waiting for the response. */
+  CONN_DONE        /**< All games played. */
+} ConnState;
+
+/**
+ * @struct Connection
+ * @brief State of one simulated player.
+ *
+ * @var Connection::fd
+ * Descriptor waited on: the socket, or the eventfd the server signals once a
+ * shared-memory channel is set up; -1 between games.
+ * @var Connection::state
+ * Current stage of the connection.
+ * @var Connection::gamesLeft
+ * Number of games still to play.
+ * @var Connection::lo
+ * Lowest number the secret can still be.
+ * @var Connection::hi
+ * Highest number the secret can still be.
+ * @var Connection::attempts
+ * Questions left in the current game.
+ * @var Connection::asked
+ * Number the last "greater than" question was about.
+ * @var Connection::sentAt
+ * Time the pending request was sent, in nanoseconds.
+ * @var Connection::name
+ * Player name.
+ * @var Connection::channel
+ * Shared-memory channel of the current game, NULL if messages go through the
+ * socket.
+ * @var Connection::channelFds
+ * Memfd and eventfds of the channel, in the order they are passed.
+ */
+typedef struct {
+  int fd;
+  ConnState state;
+  int gamesLeft;
+  int lo;
+  int hi;
+  int attempts;
+  int asked;
+  uint64_t sentAt;
+  char name[NAME_SIZE];
+  ShmChannel *channel;
+  int channelFds[SHM_CHANNEL_FDS];
+} Connection;
+
+/**
+ * @struct Options
+ * @brief Command line options of the load generator.
+ *
+ * @var Options::host
+ * Server IPv4 address.
+ * @var Options::port
+ * Server port.
+ * @var Options::connections
+ * Number of concurrent connections.
+ * @var Options::threads
+ * Number of worker threads.
+ * @var Options::games
+ * Number of games each connection plays.
+ * @var Options::prefix
+ * Prefix of the player names.
+ * @var Options::unixPath
+ * Server Unix socket to connect to instead of TCP, NULL for TCP.
+ * @var Options::shm
+ * Whether to play over shared-memory channels set up through the Unix socket.
+ */
+typedef struct {
+  const char *host;
+  int port;
+  int connections;
+  int threads;
+  int games;
+  const char *prefix;
+  const char *unixPath;
+  bool shm;
+} Options;
+
+/**
+ * @struct Worker
+ * @brief A worker thread with its connections and statistics.
+ *
+ * @var Worker::tid
+ * Thread id.
+ * @var Worker::index
+ * Worker number, part of the player names.
+ * @var Worker::options
+ * Shared command line options.
+ * @var Worker::address
+ * Server address.
+ * @var Worker::unixAddress
+ * Server Unix socket address, used if Options::unixPath is set.
+ * @var Worker::epfd
+ * Epoll descriptor of the worker's loop.
+ * @var Worker::conns
+ * Connections driven by the worker.
+ * @var Worker::count
+ * Number of connections driven by the worker.
+ * @var Worker::active
+ * Number of connections that have games left.
+ * @var Worker::connects
+ * Successful connects.
+ * @var Worker::requests
+ * Answered questions and final guesses.
+ * @var Worker::victories
+ * Games won.
+ * @var Worker::defeats
+ * Games lost.
+ * @var Worker::rejects
+ * Handshakes rejected because of a duplicate name.
+ * @var Worker::timeouts
+ * Games ended by a server timeout.
+ * @var Worker::errors
+ * Failed connects, unexpected responses and dropped connections.
+ * @var Worker::connectLatency
+ * Time from connect() to an established connection.
+ * @var Worker::handshakeLatency
+ * Time from sending the name to receiving the hello message.
+ * @var Worker::requestLatency
+ * Time from sending a question to receiving its response.
+ */
+typedef struct {
+  pthread_t tid;
+  int index;
+  const Options *options;
+  struct sockaddr_in address;
+  struct sockaddr_un unixAddress;
+  int epfd;
+  Connection *conns;
+  int count;
+  int active;
+  uint64_t connects;
+  uint64_t requests;
+  uint64_t victories;
+  uint64_t defeats;
+  uint64_t rejects;
+  uint64_t timeouts;
+  uint64_t errors;
+  HdrHist connectLatency;
+  HdrHist handshakeLatency;
+  HdrHist requestLatency;
+} Worker;
+
+/**
+ * @brief Parses and validates command line arguments.
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @param options Pointer to the options to fill.
+ * @return True if arguments are valid, false otherwise.
+ */
+bool parse_and_validate_args(int argc, char *argv[], Options *options);
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ * @return Nanoseconds since an unspecified starting point.
+ */
+uint64_t now_ns(void);
+
+/**
+ * @brief Starts a non-blocking connect for the next game of a connection.
+ * @param worker Worker owning the connection.
+ * @param conn Connection to start.
+ * @return false if the connect failed at once and the caller has to finish
+ * the game, true otherwise.
+ */
+bool start_game(Worker *worker, Connection *conn);
+
+/**
+ * @brief Closes the connection after a game and schedules the next one.
+ * @param worker Worker owning the connection.
+ * @param conn Connection whose game ended.
+ */
+void finish_game(Worker *worker, Connection *conn);
+
+/**
+ * @brief Closes the socket and shared-memory channel of a connection's game.
+ * @param worker Worker owning the connection.
+ * @param conn Connection whose game ended.
+ */
+void close_game(Worker *worker, Connection *conn);
+
+/**
+ * @brief Sends a message over the connection's transport.
+ * @param conn Connection to send on.
+ * @param message Message bytes.
+ * @param length Message length.
+ * @return True if the whole message was sent.
+ */
+bool send_message(Connection *conn, const char *message, int length);
+
+/**
+ * @brief Sends the player name, with the shared-memory channel attached if
+ * the connection uses one, and switches to waiting on the channel.
+ * @param worker Worker owning the connection.
+ * @param conn Connection that has just connected.
+ * @return True if the name was sent.
+ */
+bool send_name(Worker *worker, Connection *conn);
+
+/**
+ * @brief Sends the next binary search question or the final guess.
+ * @param worker Worker owning the connection.
+ * @param conn Connection in the playing stage.
+ */
+void ask_next(Worker *worker, Connection *conn);
+
+/**
+ * @brief Handles readiness of a connection's socket.
+ * @param worker Worker owning the connection.
+ * @param conn Connection with pending events.
+ * @param events Epoll events reported for the socket.
+ */
+void handle_event(Worker *worker, Connection *conn, uint32_t events);
+
+/**
+ * @brief Thread function running a worker's event loop.
+ * @param arg Pointer to the worker.
+ * @return NULL.
+ */
+void *worker_loop(void *arg);
+
+/**
+ * @brief Prints one latency histogram row in microseconds.
+ * @param label Row label.
+ * @param h Histogram with nanosecond values.
+ */
+void print_latency(const char *label, const HdrHist *h);
+
+/**
+ * @brief Main function of the load generator.
+ * @param argc Number of arguments.
+ * @param argv Array of argument strings.
+ * @return 0 on normal exit, or -1 on error.
+ */
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parse_and_validate_args(argc, argv, &options)) {
+    return -1;
+  }
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(options.port);
+  if (inet_pton(AF_INET, options.host, &address.sin_addr) <= 0) {
+    printf("Invalid address/ Address not supported \n");
+    return -1;
+  }
+  struct sockaddr_un unixAddress;
+  memset(&unixAddress, 0, sizeof(unixAddress));
+  unixAddress.sun_family = AF_UNIX;
+  if (options.unixPath != NULL) {
+    strcpy(unixAddress.sun_path, options.unixPath);
+  }
+
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  Worker *workers = (Worker *)calloc(options.threads, sizeof(Worker));
+  Connection *conns =
+      (Connection *)calloc(options.connections, sizeof(Connection));
+  if (workers == NULL || conns == NULL) {
+    printf("Out of memory\n");
+    return -1;
+  }
+
+  for (int i = 0, first = 0; i < options.threads; i++) {
+    Worker *worker = &workers[i];
+    worker->index = i;
+    worker->options = &options;
+    worker->address = address;
+    worker->unixAddress = unixAddress;
+    worker->conns = &conns[first];
+    worker->count = options.connections / options.threads +
+                    (i < options.connections % options.threads ? 1 : 0);
+    first += worker->count;
+    hdrInit(&worker->connectLatency);
+    hdrInit(&worker->handshakeLatency);
+    hdrInit(&worker->requestLatency);
+  }
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < options.threads; i++) {
+    pthread_create(&workers[i].tid, NULL, worker_loop, &workers[i]);
+  }
+  for (int i = 0; i < options.threads; i++) {
+    pthread_join(workers[i].tid, NULL);
+  }
+  double elapsed = (double)(now_ns() - start) / 1e9;
+
+  Worker total;
+  memset(&total, 0, sizeof(total));
+  hdrInit(&total.connectLatency);
+  hdrInit(&total.handshakeLatency);
+  hdrInit(&total.requestLatency);
+  for (int i = 0; i < options.threads; i++) {
+    total.connects += workers[i].connects;
+    total.requests += workers[i].requests;
+    total.victories += workers[i].victories;
+    total.defeats += workers[i].defeats;
+    total.rejects += workers[i].rejects;
+    total.timeouts += workers[i].timeouts;
+    total.errors += workers[i].errors;
+    hdrMerge(&total.connectLatency, &workers[i].connectLatency);
+    hdrMerge(&total.handshakeLatency, &workers[i].handshakeLatency);
+    hdrMerge(&total.requestLatency, &workers[i].requestLatency);
+  }
+
+  printf("Connections: %d, threads: %d, games per connection: %d, "
+         "transport: %s\n",
+         options.connections, options.threads, options.games,
+         options.shm ? "shared memory" : options.unixPath ? "unix" : "tcp");
+  printf("Elapsed: %.3f s\n", elapsed);
+  printf("Connects: %llu (%.1f/s)\n", (unsigned long long)total.connects,
+         total.connects / elapsed);
+  printf("Requests: %llu (%.1f/s)\n", (unsigned long long)total.requests,
+         total.requests / elapsed);
+  printf("Games: %llu won, %llu lost, %llu rejected, %llu timed out, %llu "
+         "errors\n",
+         (unsigned long long)total.victories,
+         (unsigned long long)total.defeats, (unsigned long long)total.rejects,
+         (unsigned long long)total.timeouts, (unsigned long long)total.errors);
+  printf("%-10s %10s %10s %10s %10s %10s (us)\n", "Latency", "p50", "p99",
+         "p999", "max", "mean");
+  print_latency("connect", &total.connectLatency);
+  print_latency("handshake", &total.handshakeLatency);
+  print_latency("request", &total.requestLatency);
+
+  free(conns);
+  free(workers);
+  return total.errors == 0 ? 0 : -1;
+}
+
+bool parse_and_validate_args(int argc, char *argv[], Options *options) {
+  options->host = "127.0.0.1";
+  options->port = PORT;
+  options->connections = 100;
+  options->threads = 1;
+  options->games = 1;
+  options->prefix = "load";
+  options->unixPath = NULL;
+  options->shm = false;
+
+  bool valid = argc % 2 == 1;
+  for (int i = 1; valid && i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-h") == 0) {
+      options->host = argv[i + 1];
+    } else if (strcmp(argv[i], "-p") == 0) {
+      options->port = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-c") == 0) {
+      options->connections = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-t") == 0) {
+      options->threads = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-g") == 0) {
+      options->games = atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "-n") == 0) {
+      options->prefix = argv[i + 1];
+    } else if (strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "-s") == 0) {
+      options->unixPath = argv[i + 1];
+      options->shm = argv[i][1] == 's';
+    } else {
+      valid = false;
+    }
+  }
+
+  if (!valid) {
+    printf("Usage: %s -h <host> -p <port> -c <connections> -t <threads> "
+           "-g <games> -n <name prefix> [-u <unix socket> | -s <unix socket>]"
+           "\n",
+           argv[0]);
+    return false;
+  }
+  struct sockaddr_un unixAddress;
+  if (options->unixPath != NULL &&
+      strlen(options->unixPath) >= sizeof(unixAddress.sun_path)) {
+    printf("Unix socket path is too long\n");
+    return false;
+  }
+  if (options->port < 1024 || options->port > 65535) {
+    printf("Port must be in range 1024-65535\n");
+    return false;
+  }
+  if (options->connections < 1 || options->threads < 1 || options->games < 1) {
+    printf("Connections, threads and games must be greater than 0\n");
+    return false;
+  }
+  if (options->threads > options->connections) {
+    options->threads = options->connections;
+  }
+  if (strlen(options->prefix) > NAME_SIZE - 24) {
+    printf("Name prefix is too long\n");
+    return false;
+  }
+  return true;
+}
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool start_game(Worker *worker, Connection *conn) {
+  int one = 1;
+  bool local = worker->options->unixPath != NULL;
+  if (worker->options->shm) {
+    conn->channel = shmChannelCreate(conn->channelFds);
+    if (conn->channel == NULL) {
+      perror("shared-memory channel");
+      worker->errors++;
+      conn->gamesLeft = 0;
+      conn->state = CONN_DONE;
+      worker->active--;
+      return true;
+    }
+  }
+  conn->fd = socket(local ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (conn->fd < 0) {
+    perror("socket");
+    worker->errors++;
+    close_game(worker, conn);
+    conn->gamesLeft = 0;
+    conn->state = CONN_DONE;
+    worker->active--;
+    return true;
+  }
+  if (!local) {
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+
+  conn->state = CONN_CONNECTING;
+  conn->sentAt = now_ns();
+  int result =
+      local ? connect(conn->fd, (struct sockaddr *)&worker->unixAddress,
+                      sizeof(worker->unixAddress))
+            : connect(conn->fd, (struct sockaddr *)&worker->address,
+                      sizeof(worker->address));
+  if (result < 0 && errno != EINPROGRESS) {
+    worker->errors++;
+    return false;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLOUT;
+  event.data.ptr = conn;
+  epoll_ctl(worker->epfd, EPOLL_CTL_ADD, conn->fd, &event);
+  return true;
+}
+
+void finish_game(Worker *worker, Connection *conn) {
+  // Loops rather than recursing through start_game, so that a server refusing
+  // every connect does not grow the stack by a frame per game
+  do {
+    close_game(worker, conn);
+    if (--conn->gamesLeft <= 0) {
+      conn->state = CONN_DONE;
+      worker->active--;
+      return;
+    }
+  } while (!start_game(worker, conn));
+}
+
+void close_game(Worker *worker, Connection *conn) {
+  if (conn->channel != NULL) {
+    // The server still holds the eventfd, so closing it would not take it
+    // out of the epoll set
+    if (conn->fd == conn->channelFds[2]) {
+      epoll_ctl(worker->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    }
+    // Tells the server the game is over in case it does not know yet
+    shmRingSend(&conn->channel->toServer, conn->channelFds[1], "", 0);
+    shmChannelUnmap(conn->channel);
+    conn->channel = NULL;
+    for (int i = 0; i < SHM_CHANNEL_FDS; i++) {
+      if (conn->channelFds[i] != conn->fd) {
+        close(conn->channelFds[i]);
+      }
+    }
+  }
+  if (conn->fd >= 0) {
+    close(conn->fd);
+    conn->fd = -1;
+  }
+}
+
+void ask_next(Worker *worker, Connection *conn) {
+  char message[BUFFER_SIZE];
+  int length;
+  if (conn->lo < conn->hi && conn->attempts > 0) {
+    conn->asked = conn->lo + (conn->hi - conn->lo) / 2;
+    length = protocolFormatQuestion(message, sizeof(message), CMD_GREATER,
+                                    conn->asked);
+  } else {
+    length = protocolFormatQuestion(message, sizeof(message), CMD_EQUAL,
+                                    conn->lo + (conn->hi - conn->lo) / 2);
+  }
+  conn->sentAt = now_ns();
+  if (!send_message(conn, message, length)) {
+    worker->errors++;
+    finish_game(worker, conn);
+  }
+}
+
+bool send_message(Connection *conn, const char *message, int length) {
+  if (conn->channel != NULL) {
+    return shmRingSend(&conn->channel->toServer, conn->channelFds[1], message,
+                       length) == length;
+  }
+  return send(conn->fd, message, length, MSG_NOSIGNAL) == length;
+}
+
+bool send_name(Worker *worker, Connection *conn) {
+  int size = (int)strlen(conn->name) + 1;
+  if (conn->channel == NULL) {
+    return send_message(conn, conn->name, size);
+  }
+
+  struct iovec iov = {conn->name, size};
+  struct msghdr msg;
+  char control[CMSG_SPACE(sizeof(conn->channelFds))];
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(conn->channelFds));
+  memcpy(CMSG_DATA(cmsg), conn->channelFds, sizeof(conn->channelFds));
+  if (sendmsg(conn->fd, &msg, MSG_NOSIGNAL) != size) {
+    return false;
+  }
+
+  // The server answers on the channel; the socket is no longer needed
+  close(conn->fd);
+  conn->fd = conn->channelFds[2];
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = conn;
+  epoll_ctl(worker->epfd, EPOLL_CTL_ADD, conn->fd, &event);
+  return true;
+}
+
+void handle_event(Worker *worker, Connection *conn, uint32_t events) {
+  if (conn->state == CONN_CONNECTING) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+      worker->errors++;
+      finish_game(worker, conn);
+      return;
+    }
+    uint64_t now = now_ns();
+    hdrRecord(&worker->connectLatency, now - conn->sentAt);
+    worker->connects++;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = conn;
+    epoll_ctl(worker->epfd, EPOLL_CTL_MOD, conn->fd, &event);
+
+    conn->state = CONN_HELLO;
+    conn->sentAt = now;
+    if (!send_name(worker, conn)) {
+      worker->errors++;
+      finish_game(worker, conn);
+    }
+    return;
+  }
+
+  char buffer[BUFFER_SIZE];
+  int valread =
+      conn->channel != NULL
+          ? shmRingRecv(&conn->channel->toClient, conn->fd, buffer,
+                        BUFFER_SIZE - 1)
+          : recv(conn->fd, buffer, BUFFER_SIZE - 1, 0);
+  if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+  if (valread <= 0) {
+    worker->errors++;
+    finish_game(worker, conn);
+    return;
+  }
+  buffer[valread] = '\0';
+  uint64_t latency = now_ns() - conn->sentAt;
+
+  if (conn->state == CONN_HELLO) {
+    hdrRecord(&worker->handshakeLatency, latency);
+    int min, max, attempts;
+    if (buffer[0] == RESP_NAME_TAKEN) {
+      worker->rejects++;
+      finish_game(worker, conn);
+    } else if (protocolParseHello(buffer, &min, &max, &attempts) == 0) {
+      conn->lo = min;
+      conn->hi = max;
+      conn->attempts = attempts;
+      conn->state = CONN_PLAYING;
+      ask_next(worker, conn);
+    } else {
+      worker->errors++;
+      finish_game(worker, conn);
+    }
+    return;
+  }
+
+  hdrRecord(&worker->requestLatency, latency);
+  worker->requests++;
+  char response = buffer[0];
+  if (protocolUsesAttempt(response)) {
+    conn->attempts--;
+    if (response == RESP_CORRECT) {
+      conn->lo = conn->asked + 1;
+    } else {
+      conn->hi = conn->asked;
+    }
+    ask_next(worker, conn);
+  } else if (protocolIsFinal(response)) {
+    if (response == RESP_VICTORY) {
+      worker->victories++;
+    } else if (response == RESP_DEFEAT) {
+      worker->defeats++;
+    } else {
+      worker->timeouts++;
+    }
+    finish_game(worker, conn);
+  } else {
+    worker->errors++;
+    conn->attempts = 0;
+    ask_next(worker, conn);
+  }
+}
+
+void *worker_loop(void *arg) {
+  Worker *worker = (Worker *)arg;
+  struct epoll_event events[MAX_EVENTS];
+
+  worker->epfd = epoll_create1(0);
+  if (worker->epfd < 0) {
+    perror("epoll_create1");
+    worker->errors += worker->count;
+    return NULL;
+  }
+
+  worker->active = worker->count;
+  for (int i = 0; i < worker->count; i++) {
+    Connection *conn = &worker->conns[i];
+    conn->fd = -1;
+    conn->channel = NULL;
+    conn->gamesLeft = worker->options->games;
+    snprintf(conn->name, NAME_SIZE, "%s-%d-%d", worker->options->prefix,
+             worker->index, i);
+    if (!start_game(worker, conn)) {
+      finish_game(worker, conn);
+    }
+  }
+
+  while (worker->active > 0) {
+    int ready = epoll_wait(worker->epfd, events, MAX_EVENTS, 1000);
+    if (ready < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < ready; i++) {
+      handle_event(worker, (Connection *)events[i].data.ptr, events[i].events);
+    }
+  }
+
+  close(worker->epfd);
+  return NULL;
+}
+
+void print_latency(const char *label, const HdrHist *h) {
+  printf("%-10s %10.1f %10.1f %10.1f %10.1f %10.1f\n", label,
+         hdrPercentile(h, 50.0) / 1e3, hdrPercentile(h, 99.0) / 1e3,
+         hdrPercentile(h, 99.9) / 1e3, h->max / 1e3, hdrMean(h) / 1e3);
+}
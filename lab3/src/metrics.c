@@ -0,0 +1,183 @@
+/**
+ * @file metrics.c
+ * @brief Implementation of the sharded server metrics.
+ */
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+static MetricsShard shards[METRICS_MAX_THREADS];
+static _Atomic int shardCount;
+static _Thread_local MetricsShard *localShard;
+
+/**
+ * @struct CounterInfo
+ * @brief Exposition name and labels of a counter.
+ */
+typedef struct {
+  const char *name;
+  const char *labels;
+  const char *help;
+} CounterInfo;
+
+static const CounterInfo counterInfo[METRIC_COUNTERS] = {
+    {"guess_accepts_total", "", "Accepted connections."},
+    {"guess_sessions_closed_total", "", "Closed connections."},
+    {"guess_rejects_total", "{reason=\"duplicate_name\"}",
+     "Connections rejected before the game started."},
+    {"guess_rejects_total", "{reason=\"handshake_timeout\"}", NULL},
+    {"guess_rejects_total", "{reason=\"handshake_closed\"}", NULL},
+    {"guess_rejects_total", "{reason=\"fd_limit\"}", NULL},
+    {"guess_rejects_total", "{reason=\"no_timer\"}", NULL},
+    {"guess_messages_total", "{command=\"g\"}", "Messages by command type."},
+    {"guess_messages_total", "{command=\"l\"}", NULL},
+    {"guess_messages_total", "{command=\"e\"}", NULL},
+    {"guess_messages_total", "{command=\"b\"}", NULL},
+    {"guess_messages_total", "{command=\"invalid\"}", NULL},
+    {"guess_received_bytes_total", "", "Bytes received from clients."},
+    {"guess_sent_bytes_total", "", "Bytes sent to clients."},
+    {"guess_games_total", "{result=\"victory\"}",
+     "Finished games by result."},
+    {"guess_games_total", "{result=\"defeat\"}", NULL},
+    {"guess_games_total", "{result=\"timeout\"}", NULL},
+    {"guess_wal_records_total", "", "Records appended to the log."},
+    {"guess_wal_commits_total", "",
+     "Group commits written and synced by the log writer."},
+};
+
+static const CounterInfo histogramInfo[METRIC_HISTOGRAMS] = {
+    {"guess_loop_iteration_seconds", "",
+     "Time spent handling one event loop iteration."},
+    {"guess_handshake_seconds", "", "Time from accept to the hello message."},
+    {"guess_wal_commit_seconds", "", "Time to write and sync one log commit."},
+};
+
+static uint64_t load(_Atomic uint64_t *value) {
+  return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+static void increase(_Atomic uint64_t *value, uint64_t amount) {
+  atomic_store_explicit(value, load(value) + amount, memory_order_relaxed);
+}
+
+static MetricsShard *currentShard(void) {
+  if (localShard == NULL) {
+    metricsRegisterThread();
+  }
+  return localShard;
+}
+
+static void append(char *buffer, size_t size, size_t *length,
+                   const char *format, ...) {
+  if (*length >= size) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + *length, size - *length, format, args);
+  va_end(args);
+  if (written > 0) {
+    *length += (size_t)written;
+  }
+}
+
+int metricsRegisterThread(void) {
+  if (localShard != NULL) {
+    return 0;
+  }
+  int index = atomic_fetch_add(&shardCount, 1);
+  if (index >= METRICS_MAX_THREADS) {
+    return -1;
+  }
+  localShard = &shards[index];
+  return 0;
+}
+
+void metricsAdd(MetricCounter counter, uint64_t value) {
+  MetricsShard *shard = currentShard();
+  if (shard != NULL) {
+    increase(&shard->counters[counter], value);
+  }
+}
+
+void metricsObserve(MetricHistogram histogram, uint64_t micros) {
+  MetricsShard *shard = currentShard();
+  if (shard == NULL) {
+    return;
+  }
+  int bucket = micros <= 1 ? 0 : 64 - __builtin_clzll(micros - 1);
+  if (bucket > METRICS_BUCKETS) {
+    bucket = METRICS_BUCKETS;
+  }
+  increase(&shard->buckets[histogram][bucket], 1);
+  increase(&shard->sums[histogram], micros);
+}
+
+uint64_t metricsNowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+size_t metricsFormat(char *buffer, size_t size) {
+  int shardsUsed = atomic_load(&shardCount);
+  if (shardsUsed > METRICS_MAX_THREADS) {
+    shardsUsed = METRICS_MAX_THREADS;
+  }
+  uint64_t counters[METRIC_COUNTERS] = {0};
+  uint64_t buckets[METRIC_HISTOGRAMS][METRICS_BUCKETS + 1] = {{0}};
+  uint64_t sums[METRIC_HISTOGRAMS] = {0};
+  for (int s = 0; s < shardsUsed; s++) {
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+      counters[i] += load(&shards[s].counters[i]);
+    }
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+      for (int b = 0; b <= METRICS_BUCKETS; b++) {
+        buckets[h][b] += load(&shards[s].buckets[h][b]);
+      }
+      sums[h] += load(&shards[s].sums[h]);
+    }
+  }
+
+  size_t length = 0;
+  uint64_t closed = counters[METRIC_SESSIONS_CLOSED];
+  uint64_t accepted = counters[METRIC_ACCEPTS];
+  append(buffer, size, &length,
+         "# HELP guess_sessions_active Connected client sessions.\n"
+         "# TYPE guess_sessions_active gauge\n"
+         "guess_sessions_active %llu\n",
+         (unsigned long long)(accepted > closed ? accepted - closed : 0));
+
+  for (int i = 0; i < METRIC_COUNTERS; i++) {
+    if (counterInfo[i].help != NULL) {
+      append(buffer, size, &length, "# HELP %s %s\n# TYPE %s counter\n",
+             counterInfo[i].name, counterInfo[i].help, counterInfo[i].name);
+    }
+    append(buffer, size, &length, "%s%s %llu\n", counterInfo[i].name,
+           counterInfo[i].labels, (unsigned long long)counters[i]);
+  }
+
+  for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+    const char *name = histogramInfo[h].name;
+    append(buffer, size, &length, "# HELP %s %s\n# TYPE %s histogram\n", name,
+           histogramInfo[h].help, name);
+    uint64_t cumulative = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+      cumulative += buckets[h][b];
+      append(buffer, size, &length, "%s_bucket{le=\"%g\"} %llu\n", name,
+             (double)(1ULL << b) / 1e6, (unsigned long long)cumulative);
+    }
+    cumulative += buckets[h][METRICS_BUCKETS];
+    append(buffer, size, &length,
+           "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n", name,
+           (unsigned long long)cumulative, name, (double)sums[h] / 1e6, name,
+           (unsigned long long)cumulative);
+  }
+
+  if (length >= size) {
+    length = size > 0 ? size - 1 : 0;
+  }
+  return length;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file metrics.h
+ * @brief Live counters and histograms of the server.
+ *
+ * Every thread that records metrics owns a cache-line aligned shard and is
+ * the only writer of it, so recording is a relaxed load and store without
+ * locks or read-modify-write instructions. A scrape sums all shards with
+ * relaxed loads and renders them in the Prometheus text exposition format.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_MAX_THREADS 8
+#define METRICS_BUCKETS 24
+
+/**
+ * @enum MetricCounter
+ * @brief Counters kept by every shard.
+ */
+typedef enum {
+  METRIC_ACCEPTS,                 /**< Accepted connections. */
+  METRIC_SESSIONS_CLOSED,         /**< Closed connections. */
+  METRIC_REJECT_DUPLICATE_NAME,   /**< Handshakes answered with 'u'. */
+  METRIC_REJECT_HANDSHAKE_TIMEOUT, /**< Name not received in time. */
+  METRIC_REJECT_HANDSHAKE_CLOSED, /**< Closed before sending a name. */
+  METRIC_REJECT_FD_LIMIT,         /**< Sockets not fitting into fd_set. */
+  METRIC_REJECT_NO_TIMER,         /**< Sessions whose deadline was not armed. */
+  METRIC_MESSAGES_GREATER,        /**< 'g' questions. */
+  METRIC_MESSAGES_LESS,           /**< 'l' questions. */
+  METRIC_MESSAGES_EQUAL,          /**< 'e' guesses. */
+  METRIC_MESSAGES_LEADERBOARD,    /**< 'b' leaderboard requests. */
+  METRIC_MESSAGES_INVALID,        /**< Malformed or unknown messages. */
+  METRIC_BYTES_IN,                /**< Bytes received from clients. */
+  METRIC_BYTES_OUT,               /**< Bytes sent to clients. */
+  METRIC_GAMES_VICTORY,           /**< Games won. */
+  METRIC_GAMES_DEFEAT,            /**< Games lost. */
+  METRIC_GAMES_TIMEOUT,           /**< Games ended by a timeout. */
+  METRIC_WAL_RECORDS,             /**< Records appended to the log. */
+  METRIC_WAL_COMMITS,             /**< Group commits of the log. */
+  METRIC_COUNTERS                 /**< Number of counters. */
+} MetricCounter;
+
+/**
+ * @enum MetricHistogram
+ * @brief Histograms kept by every shard.
+ */
+typedef enum {
+  METRIC_LOOP_TIME,       /**< Work done per event loop iteration. */
+  METRIC_HANDSHAKE_TIME,  /**< Time from accept to the hello message. */
+  METRIC_WAL_COMMIT_TIME, /**< Write and sync of one log commit. */
+  METRIC_HISTOGRAMS       /**< Number of histograms. */
+} MetricHistogram;
+
+/**
+ * @struct MetricsShard
+ * @brief Metrics written by a single thread.
+ *
+ * @var MetricsShard::counters
+ * Counter values.
+ * @var MetricsShard::buckets
+ * Histogram counts; bucket k holds values up to 2^k microseconds, the last
+ * one everything above.
+ * @var MetricsShard::sums
+ * Sums of the histogram values in microseconds.
+ */
+typedef struct {
+  _Alignas(64) _Atomic uint64_t counters[METRIC_COUNTERS];
+  _Atomic uint64_t buckets[METRIC_HISTOGRAMS][METRICS_BUCKETS + 1];
+  _Atomic uint64_t sums[METRIC_HISTOGRAMS];
+} MetricsShard;
+
+/**
+ * @brief Attaches the calling thread to a free shard.
+ * @return 0 on success, -1 if all METRICS_MAX_THREADS shards are taken.
+ */
+int metricsRegisterThread(void);
+
+/**
+ * @brief Adds a value to a counter of the calling thread's shard.
+ * @param counter Counter to increase.
+ * @param value Amount to add.
+ */
+void metricsAdd(MetricCounter counter, uint64_t value);
+
+/**
+ * @brief Records a value in a histogram of the calling thread's shard.
+ * @param histogram Histogram to update.
+ * @param micros Value in microseconds.
+ */
+void metricsObserve(MetricHistogram histogram, uint64_t micros);
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ * @return Microseconds since an unspecified starting point.
+ */
+uint64_t metricsNowUs(void);
+
+/**
+ * @brief Renders all shards in the Prometheus text format.
+ * @param buffer Destination buffer.
+ * @param size Size of the destination buffer.
+ * @return Length of the text, truncated to size - 1 if the buffer is short.
+ */
+size_t metricsFormat(char *buffer, size_t size);
+
+#endif
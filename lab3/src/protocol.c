@@ -0,0 +1,33 @@
+/**
+ * @file protocol.c
+ * @brief Helpers for the "Guess the Number" application protocol.
+ */
+#include "protocol.h"
+
+#include <stdio.h>
+
+int protocolFormatQuestion(char *buffer, size_t size, char command,
+                           int number) {
+  int length = snprintf(buffer, size, "%c %d", command, number);
+  if (length < 0 || (size_t)length >= size) {
+    return -1;
+  }
+  return length;
+}
+
+int protocolParseHello(const char *buffer, int *min, int *max, int *attempts) {
+  if (buffer[0] != RESP_HELLO ||
+      sscanf(buffer, "h %d %d %d", min, max, attempts) != 3) {
+    return -1;
+  }
+  return 0;
+}
+
+int protocolIsFinal(char response) {
+  return response == RESP_VICTORY || response == RESP_DEFEAT ||
+         response == RESP_TIMEOUT;
+}
+
+int protocolUsesAttempt(char response) {
+  return response == RESP_CORRECT || response == RESP_INCORRECT;
+}
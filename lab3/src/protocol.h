@@ -0,0 +1,73 @@
+/**
+ * @file protocol.h
+ * @brief Messages of the "Guess the Number" application protocol.
+ *
+ * After connecting, the client sends its name (terminated by '\0'). The server
+ * answers with a hello message "h <min> <max> <attempts>" or with "u" if the
+ * name is taken. Every question is "<command> <number>" and is answered with a
+ * single response character.
+ *
+ * "b <count>" asks for the leaderboard and costs no attempt. The answer is
+ * "r <rank> <players>\n", the player's own rank (0 before the first finished
+ * game) and the number of ranked players, followed by up to count lines
+ * "<wins> <games> <attempts used> <name>\n" from the top, as many as fit into
+ * one message.
+ */
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+
+#define CMD_GREATER 'g' /**< Question "is X greater than Y?". */
+#define CMD_LESS 'l'    /**< Question "is X less than Y?". */
+#define CMD_EQUAL 'e'   /**< Final guess "is X equal to Y?". */
+#define CMD_LEADERBOARD 'b' /**< Request for the top players. */
+
+#define RESP_HELLO 'h'       /**< Game accepted, range and attempts follow. */
+#define RESP_NAME_TAKEN 'u'  /**< Name is already used by another player. */
+#define RESP_CORRECT 'c'     /**< Answer "yes" to a question. */
+#define RESP_INCORRECT 'i'   /**< Answer "no" to a question. */
+#define RESP_VICTORY 'v'     /**< Final guess is right, game over. */
+#define RESP_DEFEAT 'd'      /**< Final guess is wrong, game over. */
+#define RESP_FORMAT 'f'      /**< Message is not "<command> <number>". */
+#define RESP_QUESTION 'q'    /**< Unknown command. */
+#define RESP_NO_ATTEMPTS 'o' /**< No attempts left for questions. */
+#define RESP_TIMEOUT 't'     /**< Session timed out, game over. */
+#define RESP_LEADERBOARD 'r' /**< Leaderboard, ranks and players follow. */
+
+/**
+ * @brief Formats a question message.
+ * @param buffer Destination buffer.
+ * @param size Size of the destination buffer.
+ * @param command One of CMD_GREATER, CMD_LESS, CMD_EQUAL.
+ * @param number Number the question is about.
+ * @return Length of the message, or -1 if it does not fit.
+ */
+int protocolFormatQuestion(char *buffer, size_t size, char command,
+                           int number);
+
+/**
+ * @brief Parses the server's hello message.
+ * @param buffer Received message, '\0'-terminated.
+ * @param min Pointer to the lower bound of the range.
+ * @param max Pointer to the upper bound of the range.
+ * @param attempts Pointer to the number of attempts.
+ * @return 0 on success, -1 if the message is not a valid hello.
+ */
+int protocolParseHello(const char *buffer, int *min, int *max, int *attempts);
+
+/**
+ * @brief Tells whether a response ends the game and the connection.
+ * @param response Response character.
+ * @return Non-zero for victory, defeat and timeout.
+ */
+int protocolIsFinal(char response);
+
+/**
+ * @brief Tells whether a response consumed one of the player's attempts.
+ * @param response Response character.
+ * @return Non-zero for "correct" and "incorrect" answers.
+ */
+int protocolUsesAttempt(char response);
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file rng.c
+ * @brief Implementation of the per-session pseudo-random generator.
+ */
+#include "rng.h"
+
+static uint64_t splitMix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+void rngSeed(Rng *rng, uint64_t seed, uint64_t stream) {
+  uint64_t x = seed;
+  uint64_t key = splitMix64(&x) ^ stream;
+  x = key;
+  for (int i = 0; i < 4; i++) {
+    rng->s[i] = splitMix64(&x);
+  }
+}
+
+uint64_t rngNext(Rng *rng) {
+  uint64_t *s = rng->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+int rngRange(Rng *rng, int min, int max) {
+  uint32_t range = (uint32_t)((int64_t)max - min) + 1;
+  if (range == 0) {
+    return (int)(uint32_t)rngNext(rng);
+  }
+  /* Lemire's multiply-shift with rejection of the biased low products. */
+  uint64_t product = (uint64_t)(uint32_t)(rngNext(rng) >> 32) * range;
+  uint32_t low = (uint32_t)product;
+  if (low < range) {
+    uint32_t threshold = -range % range;
+    while (low < threshold) {
+      product = (uint64_t)(uint32_t)(rngNext(rng) >> 32) * range;
+      low = (uint32_t)product;
+    }
+  }
+  return min + (int)(product >> 32);
+}
@@ -0,0 +1,50 @@
+/**
+ * @file rng.h
+ * @brief Small per-session pseudo-random generator for game setup.
+ *
+ * The generator is xoshiro256** with its state expanded by SplitMix64 from a
+ * (seed, stream) pair. Every session owns its generator, so no state is shared
+ * between sessions or threads and a game is fully determined by the server
+ * seed and the session id.
+ */
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/**
+ * @struct Rng
+ * @brief State of a xoshiro256** generator.
+ *
+ * @var Rng::s
+ * The 256-bit generator state.
+ */
+typedef struct {
+  uint64_t s[4];
+} Rng;
+
+/**
+ * @brief Seeds a generator for one stream of a seed.
+ * @param rng Generator to seed.
+ * @param seed Global seed, e.g. from the configuration file.
+ * @param stream Stream number, e.g. the session id.
+ */
+void rngSeed(Rng *rng, uint64_t seed, uint64_t stream);
+
+/**
+ * @brief Returns the next 64 random bits.
+ * @param rng Generator to advance.
+ * @return Uniformly distributed 64-bit value.
+ */
+uint64_t rngNext(Rng *rng);
+
+/**
+ * @brief Returns a uniformly distributed integer without modulo bias.
+ * @param rng Generator to advance.
+ * @param min Lower bound, inclusive.
+ * @param max Upper bound, inclusive; must not be less than min.
+ * @return Integer in the range [min, max].
+ */
+int rngRange(Rng *rng, int min, int max);
+
+#endif
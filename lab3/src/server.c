@@ -6,30 +6,107 @@
  * This server program implements the game logic for a simple "Guess the Number"
  * game, which can be played by multiple clients simultaneously. It uses TCP/IP
  * sockets to communicate with clients, and handles each client's game state
- * independently.
+ * independently. Handshake deadlines, idle timeouts and game time limits are
+ * driven by a timer wheel whose nearest deadline bounds the select() timeout.
+ * Every game is derived from the configured seed and the session id alone, so
+ * a session can be replayed regardless of how connections interleave.
+ * Live counters are served in the Prometheus text format on a separate admin
+ * socket bound to the loopback interface.
+ *
+ * SIGHUP re-reads the configuration file; the new game settings apply to
+ * sessions started afterwards. SIGTERM and SIGINT stop the server cleanly,
+ * flushing the write-ahead log. With -H the server also listens on a Unix
+ * socket through which a new server process started with -T takes over the
+ * listening sockets and all live sessions, so upgrades drop no connections.
+ *
+ * With -U the game is also served on a Unix stream socket for clients on the
+ * same host. Such a client may attach a shared-memory channel to its name
+ * (see shmring.h), after which its messages bypass the socket layer entirely.
+ * Sessions of all transports live in the same table and event loop.
+ *
+ * With -W every game start, answered question and game result is appended to
+ * a write-ahead log (see wal.h) whose writer thread batches and syncs the
+ * records off the event loop. After a crash or restart the log restores the
+ * leaderboard, and a player reconnecting under the same name resumes an
+ * unfinished game where it stopped. Players ask for the leaderboard with the
+ * "b" command.
  */
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "leaderboard.h"
+#include "metrics.h"
+#include "rng.h"
+#include "shmring.h"
+#include "timerwheel.h"
+#include "wal.h"
+
 #define PORT 8080
 #define BUFFER_SIZE 256
 #define INITIAL_CLIENTS 1
+#define HANDSHAKE_TIMEOUT_MS 5000
+#define IDLE_TIMEOUT_MS 60000
+#define GAME_TIMEOUT_MS 600000
+#define ADMIN_PORT_OFFSET 1
+#define MAX_ADMIN_CLIENTS 8
+#define ADMIN_TIMEOUT_MS 2000
+#define METRICS_BUFFER_SIZE 16384
+#define HANDOVER_MAGIC 0x47554553
+#define HANDOVER_VERSION 3
+#define HANDOVER_BATCH 64
+#define HANDOVER_TIMEOUT_S 5
+
+/**
+ * @enum SessionState
+ * @brief Lifecycle stage of a client slot.
+ */
+typedef enum {
+  SESSION_FREE,      /**< Slot is unused. */
+  SESSION_HANDSHAKE, /**< Connection accepted, waiting for the player name. */
+  SESSION_PLAYING,   /**< Name accepted, game in progress. */
+  SESSION_FINISHED   /**< Game over and logged, slot about to be closed. */
+} SessionState;
+
+/**
+ * @enum Transport
+ * @brief How the messages of a session are carried.
+ */
+typedef enum {
+  TRANSPORT_TCP,  /**< TCP connection. */
+  TRANSPORT_UNIX, /**< Unix stream connection. */
+  TRANSPORT_SHM   /**< Shared-memory channel set up over a Unix connection. */
+} Transport;
+
+/**
+ * @enum TimerKind
+ * @brief Types of the timers armed for a client slot.
+ */
+typedef enum {
+  TIMER_HANDSHAKE, /**< Player name was not received in time. */
+  TIMER_IDLE,      /**< Player sent nothing for too long. */
+  TIMER_GAME,      /**< Game exceeded its total time limit. */
+  TIMER_ADMIN      /**< Metrics request was not received in time. */
+} TimerKind;
 
 /**
  * @struct ClientData
  * @brief Holds individual client game data.
  *
  * @var ClientData::socket
- * The socket descriptor for the client connection.
+ * The socket descriptor for the client connection; for a shared-memory
+ * session the eventfd signalled by the client.
  * @var ClientData::name
  * The client's username.
  * @var ClientData::min
@@ -40,6 +117,27 @@
  * The secret number the client needs to guess.
  * @var ClientData::attempts
  * The number of attempts the client has to guess the number.
+ * @var ClientData::moves
+ * Questions answered in the current game.
+ * @var ClientData::state
+ * The lifecycle stage of the slot.
+ * @var ClientData::idleTimer
+ * Timer id of the idle timeout, -1 if not armed.
+ * @var ClientData::limitTimer
+ * Timer id of the handshake deadline or the game time limit, -1 if not armed.
+ * @var ClientData::sessionId
+ * Server-wide sequence number of the session, selects the game's random
+ * stream.
+ * @var ClientData::acceptedAt
+ * Time the connection was accepted, in microseconds.
+ * @var ClientData::transport
+ * How the session's messages are carried.
+ * @var ClientData::channel
+ * Shared memory of a shared-memory session, NULL otherwise.
+ * @var ClientData::channelFd
+ * Memfd of the shared memory, -1 if none.
+ * @var ClientData::notifyFd
+ * Eventfd signalled for the client, -1 if none.
  */
 typedef struct {
   int socket;
@@ -48,6 +146,16 @@ typedef struct {
   int max;
   int secretNumber;
   int attempts;
+  uint32_t moves;
+  SessionState state;
+  int idleTimer;
+  int limitTimer;
+  uint64_t sessionId;
+  uint64_t acceptedAt;
+  Transport transport;
+  ShmChannel *channel;
+  int channelFd;
+  int notifyFd;
 } ClientData;
 
 /**
@@ -77,18 +185,249 @@ typedef struct {
 } GameData;
 
 /**
- * @brief Accepts a new client, sets up its game data, and registers it.
- * @param server_fd Socket descriptor for the server.
- * @param address Struct containing address information of the server.
- * @param client_data Pointer to the array of client data structures.
- * @param client_capacity Pointer to the current capacity of the client data
- * array.
- * @param gameData Pointer to the game configuration data.
+ * @struct Server
+ * @brief Holds the state shared by the event loop and its handlers.
+ *
+ * @var Server::client_data
+ * Array of client slots.
+ * @var Server::client_capacity
+ * Current capacity of the client slot array.
+ * @var Server::gameData
+ * Game configuration applied to new sessions.
+ * @var Server::timers
+ * Timer wheel holding the deadlines of all sessions.
+ * @var Server::seed
+ * Seed of the game generator from the configuration file.
+ * @var Server::nextSessionId
+ * Id given to the next accepted connection.
+ * @var Server::admin_fd
+ * Listening socket of the metrics endpoint.
+ * @var Server::admin_clients
+ * Connections to the metrics endpoint, 0 for unused entries.
+ * @var Server::admin_timers
+ * Timer ids of the metrics connections.
+ * @var Server::server_fd
+ * Listening socket of the game.
+ * @var Server::port
+ * Port of the game's listening socket.
+ * @var Server::unix_fd
+ * Listening Unix socket of the game, -1 if none.
+ * @var Server::config_path
+ * Configuration file re-read on SIGHUP, NULL if none was given.
+ * @var Server::handover_path
+ * Path of the handover socket, NULL if handover is disabled.
+ * @var Server::handover_fd
+ * Listening handover socket, -1 if handover is disabled.
+ * @var Server::wal_path
+ * Path of the write-ahead log, NULL if games are not logged.
+ * @var Server::wal
+ * The open write-ahead log.
+ * @var Server::leaderboard
+ * Ranking of all players by their finished games.
+ * @var Server::resumable
+ * Games left unfinished by a previous process, waiting for their player.
+ * @var Server::resumable_count
+ * Number of entries in resumable.
+ */
+typedef struct {
+  ClientData *client_data;
+  int client_capacity;
+  GameData gameData;
+  TimerWheel timers;
+  int seed;
+  uint64_t nextSessionId;
+  int admin_fd;
+  int admin_clients[MAX_ADMIN_CLIENTS];
+  int admin_timers[MAX_ADMIN_CLIENTS];
+  int server_fd;
+  int port;
+  int unix_fd;
+  const char *config_path;
+  const char *handover_path;
+  int handover_fd;
+  const char *wal_path;
+  Wal wal;
+  Leaderboard leaderboard;
+  WalSession *resumable;
+  int resumable_count;
+} Server;
+
+/**
+ * @struct HandoverHeader
+ * @brief First message of a handover, carries the listening sockets.
+ *
+ * @var HandoverHeader::magic
+ * HANDOVER_MAGIC.
+ * @var HandoverHeader::version
+ * HANDOVER_VERSION.
+ * @var HandoverHeader::sessions
+ * Number of session records sent after the header.
+ * @var HandoverHeader::hasAdmin
+ * Whether the metrics socket follows the game socket.
+ * @var HandoverHeader::hasUnix
+ * Whether the game's Unix socket comes last.
+ * @var HandoverHeader::seed
+ * Seed of the game generator.
+ * @var HandoverHeader::port
+ * Port of the game's listening socket.
+ * @var HandoverHeader::nextSessionId
+ * Id to give to the next accepted connection.
+ * @var HandoverHeader::gameData
+ * Game configuration applied to new sessions.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t sessions;
+  int32_t hasAdmin;
+  int32_t hasUnix;
+  int32_t seed;
+  int32_t port;
+  uint64_t nextSessionId;
+  GameData gameData;
+} HandoverHeader;
+
+/**
+ * @struct HandoverSession
+ * @brief State of one live session, sent along with its socket.
+ *
+ * @var HandoverSession::sessionId
+ * Server-wide sequence number of the session.
+ * @var HandoverSession::acceptedAt
+ * Time the connection was accepted, in microseconds.
+ * @var HandoverSession::idleRemaining
+ * Milliseconds left until the idle timeout, -1 if not armed.
+ * @var HandoverSession::limitRemaining
+ * Milliseconds left until the handshake or game deadline, -1 if not armed.
+ * @var HandoverSession::state
+ * Lifecycle stage of the session.
+ * @var HandoverSession::transport
+ * Transport of the session; a shared-memory session passes its eventfd, the
+ * client's eventfd and the memfd, the others their socket.
+ * @var HandoverSession::min
+ * The minimum number in the range for guessing.
+ * @var HandoverSession::max
+ * The maximum number in the range for guessing.
+ * @var HandoverSession::secretNumber
+ * The secret number the client needs to guess.
+ * @var HandoverSession::attempts
+ * The number of attempts left.
+ * @var HandoverSession::moves
+ * Questions answered in the current game.
+ * @var HandoverSession::name
+ * The client's username.
+ */
+typedef struct {
+  uint64_t sessionId;
+  uint64_t acceptedAt;
+  int64_t idleRemaining;
+  int64_t limitRemaining;
+  int32_t state;
+  int32_t transport;
+  int32_t min;
+  int32_t max;
+  int32_t secretNumber;
+  int32_t attempts;
+  uint32_t moves;
+  char name[BUFFER_SIZE];
+} HandoverSession;
+
+/** Set by the SIGHUP handler, cleared once the configuration is reloaded. */
+static volatile sig_atomic_t reload_requested = 0;
+
+/** Set by the SIGTERM and SIGINT handler to leave the event loop. */
+static volatile sig_atomic_t shutdown_requested = 0;
+
+/**
+ * @brief Accepts a new client and registers it in a free slot.
+ *
+ * The player name is not read here: the slot is put into the handshake state
+ * with a deadline timer and the name is read by the event loop once the socket
+ * becomes readable.
+ *
+ * @param server_fd Listening socket with a pending connection, TCP or Unix.
+ * @param server Pointer to the server state.
  * @return The socket descriptor of the newly accepted client or -1 on failure.
  */
-int acceptNewClient(int server_fd, struct sockaddr_in address,
-                    ClientData **client_data, int *client_capacity,
-                    GameData *gameData);
+int acceptNewClient(int server_fd, Server *server);
+
+/**
+ * @brief Reads the player name, checks it and starts the game.
+ *
+ * A name received on a Unix connection may carry the descriptors of a
+ * shared-memory channel; the session then switches to the channel and the
+ * connection is closed.
+ *
+ * @param server Pointer to the server state.
+ * @param index Index of the client slot in the handshake state.
+ */
+void completeHandshake(Server *server, int index);
+
+/**
+ * @brief Switches a Unix session to the shared-memory channel it sent.
+ * @param client Pointer to the client's data structure.
+ * @param fds Descriptors received with the name.
+ * @param count Number of descriptors received.
+ * @return 0 on success, -1 if the descriptors are not a sealed channel and two
+ * eventfds; they are left to the caller then.
+ */
+int attachChannel(ClientData *client, const int *fds, int count);
+
+/**
+ * @brief Generates the range, attempts and secret number of a session.
+ *
+ * The values depend only on the seed, the session id and the game
+ * configuration, so the same session id always yields the same game.
+ *
+ * @param client Pointer to the client's data structure.
+ * @param gameData Pointer to the game configuration data.
+ * @param seed Seed of the game generator.
+ */
+void setupGame(ClientData *client, const GameData *gameData, int seed);
+
+/**
+ * @brief Continues a game a previous process left unfinished, if the player
+ * has one.
+ * @param server Pointer to the server state.
+ * @param client Pointer to the client's data structure, name already set.
+ * @return 1 if a game was resumed, 0 otherwise.
+ */
+int resumeSession(Server *server, ClientData *client);
+
+/**
+ * @brief Logs the start of a game or an answered question.
+ * @param server Pointer to the server state.
+ * @param client Pointer to the client's data structure.
+ * @param type WAL_GAME_START or WAL_GAME_MOVE.
+ */
+void logSession(Server *server, ClientData *client, WalRecordType type);
+
+/**
+ * @brief Records the result of a game in the log and the leaderboard.
+ * @param server Pointer to the server state.
+ * @param index Index of the client slot; left in the finished state.
+ * @param result How the game ended.
+ */
+void finishGame(Server *server, int index, WalResult result);
+
+/**
+ * @brief Answers a leaderboard request.
+ * @param server Pointer to the server state.
+ * @param client Pointer to the client's data structure.
+ * @param count Number of top players requested.
+ */
+void sendLeaderboard(Server *server, ClientData *client, int count);
+
+/**
+ * @brief Recovers the write-ahead log and continues it.
+ *
+ * Unfinished games of sessions that are already live, i.e. taken over from
+ * the previous process, are not offered for resuming.
+ *
+ * @param server Pointer to the server state.
+ * @return 0 on success, -1 on failure.
+ */
+int openLog(Server *server);
 
 /**
  * @brief Initializes the client data for new or expanding client arrays.
@@ -106,14 +445,154 @@ void initializeClientData(ClientData *client_data, int start,
  */
 int setupServerSocket(int port);
 
+/**
+ * @brief Creates a listening Unix socket, replacing a stale one at path.
+ * @param path Filesystem path of the socket.
+ * @param type SOCK_STREAM or SOCK_SEQPACKET.
+ * @param backlog Length of the queue of pending connections.
+ * @return The non-blocking socket descriptor, or -1 on failure.
+ */
+int setupUnixSocket(const char *path, int type, int backlog);
+
+/**
+ * @brief Sets up the metrics socket on the loopback interface.
+ * @param port The port on which the metrics endpoint should listen.
+ * @return The socket descriptor for the endpoint, or -1 on failure.
+ */
+int setupAdminSocket(int port);
+
+/**
+ * @brief Accepts a connection to the metrics endpoint.
+ * @param server Pointer to the server state.
+ */
+void acceptAdminClient(Server *server);
+
+/**
+ * @brief Answers a metrics request with the current counters and closes the
+ * connection.
+ * @param server Pointer to the server state.
+ * @param index Index of the metrics connection.
+ */
+void serveMetrics(Server *server, int index);
+
+/**
+ * @brief Sends a message to a client over its transport and counts the bytes
+ * sent.
+ * @param client The client's data structure.
+ * @param message Message to send.
+ * @param length Length of the message.
+ * @return Number of bytes sent, or -1 on error.
+ */
+ssize_t sendToClient(ClientData *client, const char *message, size_t length);
+
+/**
+ * @brief Receives a message from a client over its transport and counts the
+ * bytes received.
+ * @param client The client's data structure.
+ * @param buffer Destination buffer.
+ * @param length Size of the destination buffer.
+ * @return Number of bytes received, 0 on disconnect, or -1 on error.
+ */
+ssize_t recvFromClient(ClientData *client, char *buffer, size_t length);
+
 /**
  * @brief Handles the activity for a specific client.
- * @param sd The socket descriptor of the client.
- * @param client_data Pointer to the client's data structure.
- * @param address Struct containing the client's address information.
+ * @param server Pointer to the server state.
+ * @param index Index of the client slot with pending input.
+ */
+void handleClientActivity(Server *server, int index);
+
+/**
+ * @brief Closes the client connection, disarms its timers and frees the slot.
+ * @param server Pointer to the server state.
+ * @param index Index of the client slot.
  */
-void handleClientActivity(int sd, ClientData *client_data,
-                          struct sockaddr_in address);
+void closeClient(Server *server, int index);
+
+/**
+ * @brief Closes a session whose deadline could not be armed.
+ *
+ * A session without its timers would never be evicted, so it is dropped
+ * rather than served.
+ *
+ * @param server Pointer to the server state.
+ * @param index Index of the client slot.
+ */
+void rejectWithoutTimer(Server *server, int index);
+
+/**
+ * @brief Timer wheel callback closing sessions whose deadline has passed.
+ * @param kind Type of the expired timer, one of TimerKind.
+ * @param owner Index of the client slot the timer belongs to.
+ * @param ctx Pointer to the server state.
+ */
+void onTimerExpired(int kind, int owner, void *ctx);
+
+/**
+ * @brief SIGHUP handler requesting a configuration reload.
+ * @param signo Signal number.
+ */
+void onReloadSignal(int signo);
+
+/**
+ * @brief SIGTERM and SIGINT handler requesting a clean shutdown.
+ * @param signo Signal number.
+ */
+void onShutdownSignal(int signo);
+
+/**
+ * @brief Re-reads the configuration file and applies it to new sessions.
+ * @param server Pointer to the server state.
+ */
+void reloadConfig(Server *server);
+
+/**
+ * @brief Creates the Unix socket new server processes take over from.
+ * @param path Filesystem path of the socket.
+ * @return The socket descriptor, or -1 on failure.
+ */
+int setupHandoverSocket(const char *path);
+
+/**
+ * @brief Passes the listening sockets and all sessions to a new process.
+ *
+ * On success the new process owns every connection and this process exits.
+ * On failure the server keeps running as before.
+ *
+ * @param server Pointer to the server state.
+ */
+void performHandover(Server *server);
+
+/**
+ * @brief Takes over the listening sockets and sessions of a running server.
+ * @param server Pointer to the server state to fill.
+ * @return 0 on success, -1 on failure.
+ */
+int receiveHandover(Server *server);
+
+/**
+ * @brief Sends a handover message with attached descriptors.
+ * @param sock Connected SOCK_SEQPACKET Unix socket.
+ * @param data Message payload.
+ * @param length Length of the payload.
+ * @param fds Descriptors to pass.
+ * @param count Number of descriptors.
+ * @return 0 on success, -1 on failure.
+ */
+int sendWithFds(int sock, const void *data, size_t length, const int *fds,
+                int count);
+
+/**
+ * @brief Receives a handover message with attached descriptors.
+ * @param sock Connected SOCK_SEQPACKET Unix socket.
+ * @param data Buffer for the payload.
+ * @param length Size of the buffer.
+ * @param fds Array receiving the descriptors.
+ * @param count Size of the descriptor array; set to the number received.
+ * @return Length of the payload, or -1 on failure.
+ */
+ssize_t recvWithFds(int sock, void *data, size_t length, int *fds,
+                    int *count);
 
 /**
  * @brief Reads game configuration data from a file.
@@ -132,51 +611,171 @@ int readData(const char *filename, int *seed, int *port, GameData *gameData);
  * @return 0 on normal exit, or -1 on error.
  */
 int main(int argc, char *argv[]) {
-  GameData gameData;
-  gameData.mininit = 1;
-  gameData.maxinit = 1;
-  gameData.minfin = 100;
-  gameData.maxfin = 100;
-  gameData.minattempts = 8;
-  gameData.maxattempts = 8;
-  int port = PORT;
-  int seed = 1;
-  if (argc != 2) {
-    printf("You can use with config file: %s <path/to/conffile.txt>\n",
+  Server server;
+  server.gameData.mininit = 1;
+  server.gameData.maxinit = 1;
+  server.gameData.minfin = 100;
+  server.gameData.maxfin = 100;
+  server.gameData.minattempts = 8;
+  server.gameData.maxattempts = 8;
+  server.port = PORT;
+  server.seed = 1;
+  server.nextSessionId = 1;
+  server.config_path = NULL;
+  server.handover_path = NULL;
+  server.unix_fd = -1;
+  server.wal_path = NULL;
+  server.resumable = NULL;
+  server.resumable_count = 0;
+  leaderboardInit(&server.leaderboard);
+  const char *unix_path = NULL;
+  int takeover = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+      server.handover_path = argv[++i];
+    } else if (strcmp(argv[i], "-U") == 0 && i + 1 < argc) {
+      unix_path = argv[++i];
+    } else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+      server.wal_path = argv[++i];
+    } else if (strcmp(argv[i], "-T") == 0) {
+      takeover = 1;
+    } else {
+      server.config_path = argv[i];
+    }
+  }
+  if (takeover && server.handover_path == NULL) {
+    printf("Takeover requires the handover socket: -H <path> -T\n");
+    return -1;
+  }
+  if (server.config_path == NULL) {
+    printf("You can use with config file: %s [-U <game.sock>] "
+           "[-W <games.wal>] [-H <handover.sock> [-T]] "
+           "<path/to/conffile.txt>\n",
            argv[0]);
   } else {
-    int result = readData(argv[1], &seed, &port, &gameData);
+    int result = readData(server.config_path, &server.seed, &server.port,
+                          &server.gameData);
     if (result == -1) {
       return -1;
     }
   }
 
-  int server_fd, new_socket, max_sd, sd, activity, valread,
-      client_capacity = INITIAL_CLIENTS;
-  ClientData *client_data =
-      (ClientData *)calloc(client_capacity, sizeof(ClientData));
-  struct sockaddr_in address;
-  int opt = 1;
-  int addrlen = sizeof(address);
-  char buffer[BUFFER_SIZE];
+  int max_sd, sd, activity;
   fd_set readfds;
 
-  srand(seed);
+  server.client_capacity = INITIAL_CLIENTS;
+  server.client_data =
+      (ClientData *)calloc(server.client_capacity, sizeof(ClientData));
+  if (server.client_data == NULL ||
+      timerWheelInit(&server.timers, timerNowMs()) == -1) {
+    printf("Out of memory\n");
+    return -1;
+  }
+
+  initializeClientData(server.client_data, 0, server.client_capacity);
+  metricsRegisterThread();
+
+  for (int i = 0; i < MAX_ADMIN_CLIENTS; i++) {
+    server.admin_clients[i] = 0;
+    server.admin_timers[i] = -1;
+  }
+
+  if (takeover) {
+    if (receiveHandover(&server) == -1) {
+      return -1;
+    }
+  } else {
+    server.server_fd = setupServerSocket(server.port);
+    fcntl(server.server_fd, F_SETFL, O_NONBLOCK);
+    server.admin_fd = setupAdminSocket(server.port + ADMIN_PORT_OFFSET);
+  }
+
+  // A taken over process reads the log only now that the previous one has
+  // synced it and stopped writing
+  if (server.wal_path != NULL && openLog(&server) == -1) {
+    return -1;
+  }
+
+  if (server.unix_fd == -1 && unix_path != NULL) {
+    server.unix_fd = setupUnixSocket(unix_path, SOCK_STREAM, SOMAXCONN);
+  }
+
+  printf("Listener on port %d \n", server.port);
+  if (server.unix_fd != -1) {
+    printf("Listener on Unix socket %s\n",
+           unix_path != NULL ? unix_path : "taken over");
+  }
+  if (server.admin_fd != -1) {
+    printf("Metrics on http://127.0.0.1:%d/metrics\n",
+           server.port + ADMIN_PORT_OFFSET);
+  }
+
+  server.handover_fd = -1;
+  if (server.handover_path != NULL) {
+    server.handover_fd = setupHandoverSocket(server.handover_path);
+    if (server.handover_fd != -1) {
+      printf("Handover socket %s\n", server.handover_path);
+    }
+  }
 
-  initializeClientData(client_data, 0, client_capacity);
+  struct sigaction reload_action;
+  memset(&reload_action, 0, sizeof(reload_action));
+  reload_action.sa_handler = onReloadSignal;
+  sigemptyset(&reload_action.sa_mask);
+  sigaction(SIGHUP, &reload_action, NULL);
 
-  server_fd = setupServerSocket(port);
-  fcntl(server_fd, F_SETFL, O_NONBLOCK);
+  struct sigaction shutdown_action;
+  memset(&shutdown_action, 0, sizeof(shutdown_action));
+  shutdown_action.sa_handler = onShutdownSignal;
+  sigemptyset(&shutdown_action.sa_mask);
+  sigaction(SIGTERM, &shutdown_action, NULL);
+  sigaction(SIGINT, &shutdown_action, NULL);
 
-  printf("Listener on port %d \n", port);
+  // The signals stay blocked outside pselect(), which unblocks them while it
+  // waits: one arriving between the flag tests and the wait interrupts the
+  // wait instead of staying unnoticed until the next event
+  sigset_t handled, wait_mask;
+  sigemptyset(&handled);
+  sigaddset(&handled, SIGHUP);
+  sigaddset(&handled, SIGTERM);
+  sigaddset(&handled, SIGINT);
+  sigprocmask(SIG_BLOCK, &handled, &wait_mask);
 
-  while (1) {
+  while (!shutdown_requested) {
     FD_ZERO(&readfds);
-    FD_SET(server_fd, &readfds);
-    max_sd = server_fd;
+    FD_SET(server.server_fd, &readfds);
+    max_sd = server.server_fd;
+
+    if (server.handover_fd != -1) {
+      FD_SET(server.handover_fd, &readfds);
+      if (server.handover_fd > max_sd) {
+        max_sd = server.handover_fd;
+      }
+    }
+    if (server.unix_fd != -1) {
+      FD_SET(server.unix_fd, &readfds);
+      if (server.unix_fd > max_sd) {
+        max_sd = server.unix_fd;
+      }
+    }
+    if (server.admin_fd != -1) {
+      FD_SET(server.admin_fd, &readfds);
+      if (server.admin_fd > max_sd) {
+        max_sd = server.admin_fd;
+      }
+    }
+    for (int i = 0; i < MAX_ADMIN_CLIENTS; i++) {
+      sd = server.admin_clients[i];
+      if (sd > 0) {
+        FD_SET(sd, &readfds);
+        if (sd > max_sd) {
+          max_sd = sd;
+        }
+      }
+    }
 
-    for (int i = 0; i < client_capacity; i++) {
-      sd = client_data[i].socket;
+    for (int i = 0; i < server.client_capacity; i++) {
+      sd = server.client_data[i].socket;
       if (sd > 0) {
         FD_SET(sd, &readfds);
       }
@@ -185,154 +784,375 @@ int main(int argc, char *argv[]) {
       }
     }
 
-    activity = select(max_sd + 1, &readfds, NULL, NULL, NULL);
+    struct timespec ts, *timeout = NULL;
+    int64_t wait_ms = timerWheelTimeout(&server.timers, timerNowMs());
+    if (wait_ms >= 0) {
+      ts.tv_sec = wait_ms / 1000;
+      ts.tv_nsec = (wait_ms % 1000) * 1000000;
+      timeout = &ts;
+    }
+
+    activity = pselect(max_sd + 1, &readfds, NULL, NULL, timeout, &wait_mask);
+    uint64_t iteration_start = metricsNowUs();
 
     if ((activity < 0) && (errno != EINTR)) {
-      printf("select error");
+      printf("pselect error");
     }
 
-    if (FD_ISSET(server_fd, &readfds)) {
-      acceptNewClient(server_fd, address, &client_data, &client_capacity,
-                      &gameData);
+    if (shutdown_requested) {
+      break;
     }
+    if (reload_requested) {
+      reload_requested = 0;
+      reloadConfig(&server);
+    }
+
+    timerWheelAdvance(&server.timers, timerNowMs(), onTimerExpired, &server);
 
-    for (int i = 0; i < client_capacity; i++) {
-      if (client_data[i].socket > 0 &&
-          FD_ISSET(client_data[i].socket, &readfds)) {
-        handleClientActivity(client_data[i].socket, &client_data[i], address);
+    if (activity > 0) {
+      if (server.handover_fd != -1 && FD_ISSET(server.handover_fd, &readfds)) {
+        performHandover(&server);
+      }
+
+      if (FD_ISSET(server.server_fd, &readfds)) {
+        acceptNewClient(server.server_fd, &server);
+      }
+      if (server.unix_fd != -1 && FD_ISSET(server.unix_fd, &readfds)) {
+        acceptNewClient(server.unix_fd, &server);
+      }
+
+      if (server.admin_fd != -1 && FD_ISSET(server.admin_fd, &readfds)) {
+        acceptAdminClient(&server);
+      }
+      for (int i = 0; i < MAX_ADMIN_CLIENTS; i++) {
+        if (server.admin_clients[i] > 0 &&
+            FD_ISSET(server.admin_clients[i], &readfds)) {
+          serveMetrics(&server, i);
+        }
+      }
+
+      for (int i = 0; i < server.client_capacity; i++) {
+        if (server.client_data[i].socket > 0 &&
+            FD_ISSET(server.client_data[i].socket, &readfds)) {
+          handleClientActivity(&server, i);
+        }
       }
     }
+
+    metricsObserve(METRIC_LOOP_TIME, metricsNowUs() - iteration_start);
   }
 
-  free(client_data);
+  if (server.wal_path != NULL) {
+    walClose(&server.wal);
+  }
+  leaderboardDestroy(&server.leaderboard);
+  free(server.resumable);
+  timerWheelDestroy(&server.timers);
+  free(server.client_data);
   return 0;
 }
 
-int acceptNewClient(int server_fd, struct sockaddr_in address,
-                    ClientData **client_data, int *client_capacity,
-                    GameData *gameData) {
-  int new_socket, addrlen = sizeof(address);
-  if ((new_socket = accept(server_fd, (struct sockaddr *)&address,
+int acceptNewClient(int server_fd, Server *server) {
+  struct sockaddr_storage storage;
+  struct sockaddr_in *address = (struct sockaddr_in *)&storage;
+  int new_socket, addrlen = sizeof(storage);
+  Transport transport =
+      server_fd == server->unix_fd ? TRANSPORT_UNIX : TRANSPORT_TCP;
+  if ((new_socket = accept(server_fd, (struct sockaddr *)&storage,
                            (socklen_t *)&addrlen)) < 0) {
-    perror("accept");
-    exit(EXIT_FAILURE);
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+      perror("accept");
+    }
+    return -1;
   }
 
-  printf("New connection, socket fd is %d, ip is : %s, port : %d \n",
-         new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+  if (transport == TRANSPORT_TCP) {
+    printf("New connection, socket fd is %d, ip is : %s, port : %d \n",
+           new_socket, inet_ntoa(address->sin_addr),
+           ntohs(address->sin_port));
+  } else {
+    printf("New connection, socket fd is %d, Unix socket\n", new_socket);
+  }
+
+  if (new_socket >= FD_SETSIZE) {
+    printf("Too many connections, dropping socket fd %d\n", new_socket);
+    metricsAdd(METRIC_REJECT_FD_LIMIT, 1);
+    close(new_socket);
+    return -1;
+  }
+  metricsAdd(METRIC_ACCEPTS, 1);
 
   fcntl(new_socket, F_SETFL, O_NONBLOCK);
 
-  fd_set readfds;
-  struct timeval tv;
-  int retval, valread;
-  char name[BUFFER_SIZE] = {0};
+  int added = -1;
+  for (int i = 0; i < server->client_capacity; i++) {
+    if (server->client_data[i].socket == 0) {
+      added = i;
+      break;
+    }
+  }
 
-  FD_ZERO(&readfds);
-  FD_SET(new_socket, &readfds);
+  if (added == -1) {
+    ClientData *resized = (ClientData *)realloc(
+        server->client_data, server->client_capacity * 2 * sizeof(ClientData));
+    if (resized == NULL) {
+      printf("Out of memory, dropping connection\n");
+      close(new_socket);
+      return -1;
+    }
+    server->client_data = resized;
+    server->client_capacity *= 2;
+    initializeClientData(server->client_data, server->client_capacity / 2,
+                         server->client_capacity);
+    added = server->client_capacity / 2;
+    printf("Resized client data to %d\n", server->client_capacity);
+  }
 
-  tv.tv_sec = 5;
-  tv.tv_usec = 0;
+  ClientData *client = &server->client_data[added];
+  client->socket = new_socket;
+  client->transport = transport;
+  client->state = SESSION_HANDSHAKE;
+  client->sessionId = server->nextSessionId++;
+  client->acceptedAt = metricsNowUs();
+  client->limitTimer = timerWheelAdd(&server->timers, HANDSHAKE_TIMEOUT_MS,
+                                     TIMER_HANDSHAKE, added);
+  if (client->limitTimer == -1) {
+    rejectWithoutTimer(server, added);
+    return -1;
+  }
+  return new_socket;
+}
 
-  retval = select(new_socket + 1, &readfds, NULL, NULL, &tv);
+void completeHandshake(Server *server, int index) {
+  ClientData *client = &server->client_data[index];
+  char name[BUFFER_SIZE] = {0};
 
-  if (retval == -1) {
-    perror("select()");
-    close(new_socket);
-    return -1;
-  } else if (retval) {
-    valread = recv(new_socket, name, BUFFER_SIZE - 1, 0);
+  int valread;
+  if (client->transport == TRANSPORT_UNIX) {
+    int fds[SHM_CHANNEL_FDS];
+    int count = SHM_CHANNEL_FDS;
+    errno = 0;
+    valread = recvWithFds(client->socket, name, BUFFER_SIZE - 1, fds, &count);
     if (valread > 0) {
-      name[valread] = '\0';
-      printf("Valread: %d, Name: %s\n", valread, name);
-    } else {
-      if (valread == 0) {
-        printf("Connection closed\n");
-      } else {
-        perror("read");
+      metricsAdd(METRIC_BYTES_IN, valread);
+    } else if (errno == 0) {
+      valread = 0;
+    }
+    if (count > 0 &&
+        (valread <= 0 || attachChannel(client, fds, count) == -1)) {
+      printf("Invalid shared-memory channel\n");
+      for (int i = 0; i < count; i++) {
+        close(fds[i]);
       }
-      close(new_socket);
-      return -1;
+      valread = 0;
     }
   } else {
-    printf("No data within the timeout period.\n");
-    close(new_socket);
-    return -1;
+    valread = recvFromClient(client, name, BUFFER_SIZE - 1);
+  }
+  if (valread > 0) {
+    name[valread] = '\0';
+    printf("Valread: %d, Name: %s\n", valread, name);
+  } else {
+    if (valread == 0) {
+      printf("Connection closed\n");
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return;
+    } else {
+      perror("read");
+    }
+    metricsAdd(METRIC_REJECT_HANDSHAKE_CLOSED, 1);
+    closeClient(server, index);
+    return;
   }
 
-  int added = -1;
-  for (int i = 0; i < *client_capacity; i++) {
-    printf("Comparing %s with %s\n", (*client_data)[i].name, name);
-    if (strcmp((*client_data)[i].name, name) == 0) {
+  for (int i = 0; i < server->client_capacity; i++) {
+    if (i == index) {
+      continue;
+    }
+    printf("Comparing %s with %s\n", server->client_data[i].name, name);
+    if (strcmp(server->client_data[i].name, name) == 0) {
       char *message = "u";
-      send(new_socket, message, strlen(message), 0);
+      sendToClient(client, message, strlen(message));
       printf("Username already taken\n");
-      close(new_socket);
-      return -1;
+      metricsAdd(METRIC_REJECT_DUPLICATE_NAME, 1);
+      closeClient(server, index);
+      return;
     }
   }
-  for (int i = 0; i < *client_capacity; i++) {
-    if ((*client_data)[i].socket == 0) {
-      (*client_data)[i].socket = new_socket;
-      (*client_data)[i].min =
-          gameData->mininit +
-          rand() % (gameData->maxinit - gameData->mininit + 1);
-      (*client_data)[i].max =
-          gameData->minfin + rand() % (gameData->maxfin - gameData->minfin + 1);
-      (*client_data)[i].attempts =
-          gameData->minattempts +
-          rand() % (gameData->maxattempts - gameData->minattempts + 1);
-      (*client_data)[i].secretNumber =
-          (*client_data)[i].min +
-          rand() % ((*client_data)[i].max - (*client_data)[i].min + 1);
-      strncpy((*client_data)[i].name, name, valread);
-      printf(
-          "Adding to list of sockets as %d with secret number %d, range: %d "
-          "- %d\n",
-          i, (*client_data)[i].secretNumber, (*client_data)[i].min,
-          (*client_data)[i].max);
-      added = i;
-      break;
-    }
+
+  // The game deadlines are armed before the game starts, so that a session
+  // they cannot be armed for is turned away without a logged game
+  int limitTimer =
+      timerWheelAdd(&server->timers, GAME_TIMEOUT_MS, TIMER_GAME, index);
+  int idleTimer =
+      timerWheelAdd(&server->timers, IDLE_TIMEOUT_MS, TIMER_IDLE, index);
+  if (limitTimer == -1 || idleTimer == -1) {
+    timerWheelCancel(&server->timers, limitTimer);
+    timerWheelCancel(&server->timers, idleTimer);
+    rejectWithoutTimer(server, index);
+    return;
   }
 
-  if (added == -1) {
-    *client_capacity *= 2;
-    *client_data = (ClientData *)realloc(*client_data,
-                                         *client_capacity * sizeof(ClientData));
-    initializeClientData(*client_data, *client_capacity / 2, *client_capacity);
-    int i = *client_capacity / 2;
-    (*client_data)[i].socket = new_socket;
-    (*client_data)[i].min =
-        gameData->mininit +
-        rand() % (gameData->maxinit - gameData->mininit + 1);
-    (*client_data)[i].max =
-        gameData->minfin + rand() % (gameData->maxfin - gameData->minfin + 1);
-    (*client_data)[i].attempts =
-        gameData->minattempts +
-        rand() % (gameData->maxattempts - gameData->minattempts + 1);
-    (*client_data)[i].secretNumber =
-        (*client_data)[i].min +
-        rand() % ((*client_data)[i].max - (*client_data)[i].min + 1);
-    strncpy((*client_data)[i].name, name, valread);
-    printf("Resized client data to %d\n", *client_capacity);
-    printf(
-        "Adding to list of sockets as %d with secret number %d, range: %d - "
-        "%d\n",
-        i, (*client_data)[i].secretNumber, (*client_data)[i].min,
-        (*client_data)[i].max);
-    added = i;
+  strncpy(client->name, name, valread);
+  if (!resumeSession(server, client)) {
+    setupGame(client, &server->gameData, server->seed);
+    logSession(server, client, WAL_GAME_START);
   }
+  printf(
+      "Adding to list of sockets as %d (session %llu) with secret number %d, "
+      "range: %d - %d\n",
+      index, (unsigned long long)client->sessionId, client->secretNumber,
+      client->min, client->max);
+
+  timerWheelCancel(&server->timers, client->limitTimer);
+  client->state = SESSION_PLAYING;
+  client->limitTimer = limitTimer;
+  client->idleTimer = idleTimer;
 
   char *message = (char *)malloc(BUFFER_SIZE);
-  sprintf(message, "h %d %d %d", (*client_data)[added].min,
-          (*client_data)[added].max, (*client_data)[added].attempts);
-  send(new_socket, message, strlen(message), 0);
+  sprintf(message, "h %d %d %d", client->min, client->max, client->attempts);
+  sendToClient(client, message, strlen(message));
   printf("User accepted, send message: %s, %d, %d\n", message,
-         *client_capacity - 1, added);
+         server->client_capacity - 1, index);
   free(message);
+  metricsObserve(METRIC_HANDSHAKE_TIME, metricsNowUs() - client->acceptedAt);
+}
 
-  return new_socket;
+int attachChannel(ClientData *client, const int *fds, int count) {
+  if (count != SHM_CHANNEL_FDS || fds[1] >= FD_SETSIZE ||
+      shmEventFdCheck(fds[1]) == -1 || shmEventFdCheck(fds[2]) == -1) {
+    return -1;
+  }
+  ShmChannel *channel = shmChannelMap(fds[0]);
+  if (channel == NULL) {
+    return -1;
+  }
+  close(client->socket);
+  client->transport = TRANSPORT_SHM;
+  client->channel = channel;
+  client->channelFd = fds[0];
+  client->socket = fds[1];
+  client->notifyFd = fds[2];
+  return 0;
+}
+
+void setupGame(ClientData *client, const GameData *gameData, int seed) {
+  Rng rng;
+  rngSeed(&rng, (uint64_t)(unsigned int)seed, client->sessionId);
+  client->min = rngRange(&rng, gameData->mininit, gameData->maxinit);
+  client->max = rngRange(&rng, gameData->minfin, gameData->maxfin);
+  client->attempts =
+      rngRange(&rng, gameData->minattempts, gameData->maxattempts);
+  client->secretNumber = rngRange(&rng, client->min, client->max);
+  client->moves = 0;
+}
+
+int resumeSession(Server *server, ClientData *client) {
+  for (int i = 0; i < server->resumable_count; i++) {
+    WalSession *session = &server->resumable[i];
+    if (strcmp(session->name, client->name) == 0) {
+      printf("Resuming session %llu of %s\n",
+             (unsigned long long)session->sessionId, client->name);
+      client->sessionId = session->sessionId;
+      client->min = session->min;
+      client->max = session->max;
+      client->secretNumber = session->secretNumber;
+      client->attempts = session->attempts;
+      client->moves = session->moves;
+      *session = server->resumable[--server->resumable_count];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void logSession(Server *server, ClientData *client, WalRecordType type) {
+  if (server->wal_path == NULL) {
+    return;
+  }
+  WalRecord record;
+  memset(&record, 0, sizeof(record));
+  record.type = type;
+  record.sessionId = client->sessionId;
+  record.min = client->min;
+  record.max = client->max;
+  record.secretNumber = client->secretNumber;
+  record.attempts = client->attempts;
+  record.moves = client->moves;
+  walAppend(&server->wal, &record, client->name);
+}
+
+void finishGame(Server *server, int index, WalResult result) {
+  ClientData *client = &server->client_data[index];
+  // The final guess is an attempt too
+  uint64_t used = client->moves + (result == WAL_RESULT_VICTORY ||
+                                   result == WAL_RESULT_DEFEAT);
+  if (server->wal_path != NULL) {
+    WalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = WAL_GAME_END;
+    record.result = result;
+    record.sessionId = client->sessionId;
+    record.moves = client->moves;
+    record.attemptsUsed = used;
+    walAppend(&server->wal, &record, client->name);
+  }
+  if (leaderboardRecord(&server->leaderboard, client->name,
+                        result == WAL_RESULT_VICTORY, used) == -1) {
+    printf("Out of memory, result of %s not ranked\n", client->name);
+  }
+  client->state = SESSION_FINISHED;
+}
+
+void sendLeaderboard(Server *server, ClientData *client, int count) {
+  const Leaderboard *board = &server->leaderboard;
+  char message[BUFFER_SIZE];
+  int length = snprintf(message, sizeof(message), "r %d %d\n",
+                        leaderboardRank(board, client->name), board->count);
+  for (int rank = 1; rank <= count && rank <= board->count; rank++) {
+    const LeaderboardEntry *entry = leaderboardAt(board, rank);
+    int line = snprintf(message + length, sizeof(message) - length,
+                        "%u %u %llu %s\n", entry->wins, entry->games,
+                        (unsigned long long)entry->attemptsUsed, entry->name);
+    if (line < 0 || line >= (int)sizeof(message) - length) {
+      break;
+    }
+    length += line;
+  }
+  sendToClient(client, message, length);
+}
+
+int openLog(Server *server) {
+  WalSession *sessions;
+  int count;
+  uint64_t maxSessionId;
+  if (walOpen(&server->wal, server->wal_path, &server->leaderboard, &sessions,
+              &count, &maxSessionId) == -1) {
+    printf("Cannot open the log %s\n", server->wal_path);
+    return -1;
+  }
+  if (maxSessionId >= server->nextSessionId) {
+    server->nextSessionId = maxSessionId + 1;
+  }
+
+  server->resumable = sessions;
+  server->resumable_count = 0;
+  for (int i = 0; i < count; i++) {
+    int live = 0;
+    for (int j = 0; j < server->client_capacity; j++) {
+      if (server->client_data[j].socket > 0 &&
+          server->client_data[j].sessionId == sessions[i].sessionId) {
+        live = 1;
+        break;
+      }
+    }
+    if (!live) {
+      sessions[server->resumable_count++] = sessions[i];
+    }
+  }
+  printf("Log %s: %d players ranked, %d games to resume\n", server->wal_path,
+         server->leaderboard.count, server->resumable_count);
+  return 0;
 }
 
 void initializeClientData(ClientData *client_data, int start,
@@ -342,8 +1162,17 @@ void initializeClientData(ClientData *client_data, int start,
     client_data[i].name[0] = '\0';
     client_data[i].min = 0;
     client_data[i].max = 0;
-    client_data[i].secretNumber = rand() % 100 + 1;
+    client_data[i].secretNumber = 0;
     client_data[i].attempts = 0;
+    client_data[i].moves = 0;
+    client_data[i].state = SESSION_FREE;
+    client_data[i].idleTimer = -1;
+    client_data[i].limitTimer = -1;
+    client_data[i].sessionId = 0;
+    client_data[i].transport = TRANSPORT_TCP;
+    client_data[i].channel = NULL;
+    client_data[i].channelFd = -1;
+    client_data[i].notifyFd = -1;
   }
 }
 
@@ -372,7 +1201,7 @@ int setupServerSocket(int port) {
     exit(EXIT_FAILURE);
   }
 
-  if (listen(server_fd, 3) < 0) {
+  if (listen(server_fd, SOMAXCONN) < 0) {
     perror("listen");
     exit(EXIT_FAILURE);
   }
@@ -380,60 +1209,624 @@ int setupServerSocket(int port) {
   return server_fd;
 }
 
-void handleClientActivity(int sd, ClientData *client_data,
-                          struct sockaddr_in address) {
-  int valread, addrlen = sizeof(address);
+void handleClientActivity(Server *server, int index) {
+  ClientData *client_data = &server->client_data[index];
+
+  if (client_data->state == SESSION_HANDSHAKE) {
+    completeHandshake(server, index);
+    return;
+  }
+
+  int valread;
   char buffer[BUFFER_SIZE];
-  if ((valread = recv(sd, buffer, BUFFER_SIZE, 0)) == 0) {
-    getpeername(sd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
-    printf("Host disconnected, ip %s, port %d \n", inet_ntoa(address.sin_addr),
-           ntohs(address.sin_port));
-    close(sd);
-    client_data->socket = 0;
-    client_data->name[0] = '\0';
+  if ((valread = recvFromClient(client_data, buffer, BUFFER_SIZE - 1)) == 0) {
+    closeClient(server, index);
+  } else if (valread < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      perror("recv");
+      closeClient(server, index);
+    }
   } else {
+    timerWheelCancel(&server->timers, client_data->idleTimer);
+    client_data->idleTimer =
+        timerWheelAdd(&server->timers, IDLE_TIMEOUT_MS, TIMER_IDLE, index);
+    if (client_data->idleTimer == -1) {
+      rejectWithoutTimer(server, index);
+      return;
+    }
+
     buffer[valread] = '\0';
     int guessedNumber;
     char command[20];
-    if (sscanf(buffer, "%s %d", command, &guessedNumber) == 2) {
+    if (sscanf(buffer, "%19s %d", command, &guessedNumber) == 2) {
       printf("Client %d: %s, Secret: %d, Attempts: %d Min: %d Max: %d\n",
              client_data->socket, buffer, client_data->secretNumber,
              client_data->attempts, client_data->min, client_data->max);
+      if (strcmp(command, "g") == 0) {
+        metricsAdd(METRIC_MESSAGES_GREATER, 1);
+      } else if (strcmp(command, "l") == 0) {
+        metricsAdd(METRIC_MESSAGES_LESS, 1);
+      } else if (strcmp(command, "e") == 0) {
+        metricsAdd(METRIC_MESSAGES_EQUAL, 1);
+      } else if (strcmp(command, "b") == 0) {
+        metricsAdd(METRIC_MESSAGES_LEADERBOARD, 1);
+      } else {
+        metricsAdd(METRIC_MESSAGES_INVALID, 1);
+      }
       if (strcmp(command, "g") == 0 && client_data->attempts > 0) {
-        send(sd, client_data->secretNumber > guessedNumber ? "c" : "i", 1, 0);
+        sendToClient(client_data,
+                     client_data->secretNumber > guessedNumber ? "c" : "i", 1);
         client_data->attempts--;
+        client_data->moves++;
+        logSession(server, client_data, WAL_GAME_MOVE);
       } else if (strcmp(command, "l") == 0 && client_data->attempts > 0) {
-        send(sd, client_data->secretNumber < guessedNumber ? "c" : "i", 1, 0);
+        sendToClient(client_data,
+                     client_data->secretNumber < guessedNumber ? "c" : "i", 1);
         client_data->attempts--;
+        client_data->moves++;
+        logSession(server, client_data, WAL_GAME_MOVE);
       } else if (strcmp(command, "e") == 0) {
         if (client_data->secretNumber == guessedNumber) {
-          send(sd, "v", strlen("v"), 0);
-          getpeername(sd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
-          printf("Victory! Host disconnected, ip %s, port %d \n",
-                 inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-          close(sd);
-          client_data->socket = 0;
-          client_data->name[0] = '\0';
+          sendToClient(client_data, "v", strlen("v"));
+          metricsAdd(METRIC_GAMES_VICTORY, 1);
+          finishGame(server, index, WAL_RESULT_VICTORY);
+          printf("Victory! ");
         } else {
-          send(sd, "d", strlen("d"), 0);
-          getpeername(sd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
-          printf("Defeat! Host disconnected, ip %s, port %d \n",
-                 inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-          close(sd);
-          client_data->socket = 0;
-          client_data->name[0] = '\0';
+          sendToClient(client_data, "d", strlen("d"));
+          metricsAdd(METRIC_GAMES_DEFEAT, 1);
+          finishGame(server, index, WAL_RESULT_DEFEAT);
+          printf("Defeat! ");
         }
+        closeClient(server, index);
+      } else if (strcmp(command, "b") == 0) {
+        sendLeaderboard(server, client_data, guessedNumber);
       } else if (strcmp(command, "g") == 0 || strcmp(command, "l") == 0) {
-        send(sd, "o", 1, 0);
+        sendToClient(client_data, "o", 1);
       } else {
-        send(sd, "q", 1, 0);
+        sendToClient(client_data, "q", 1);
       }
     } else {
-      send(sd, "f", 1, 0);
+      metricsAdd(METRIC_MESSAGES_INVALID, 1);
+      sendToClient(client_data, "f", 1);
     }
   }
 }
 
+void closeClient(Server *server, int index) {
+  ClientData *client_data = &server->client_data[index];
+  struct sockaddr_in address;
+  int addrlen = sizeof(address);
+  if (client_data->transport == TRANSPORT_TCP &&
+      getpeername(client_data->socket, (struct sockaddr *)&address,
+                  (socklen_t *)&addrlen) == 0) {
+    printf("Host disconnected, ip %s, port %d \n", inet_ntoa(address.sin_addr),
+           ntohs(address.sin_port));
+  }
+  if (client_data->state == SESSION_PLAYING) {
+    finishGame(server, index, WAL_RESULT_ABANDONED);
+  }
+  timerWheelCancel(&server->timers, client_data->idleTimer);
+  timerWheelCancel(&server->timers, client_data->limitTimer);
+  if (client_data->transport == TRANSPORT_SHM) {
+    shmRingSend(&client_data->channel->toClient, client_data->notifyFd, "", 0);
+    shmChannelUnmap(client_data->channel);
+    close(client_data->channelFd);
+    close(client_data->notifyFd);
+  }
+  close(client_data->socket);
+  metricsAdd(METRIC_SESSIONS_CLOSED, 1);
+  initializeClientData(server->client_data, index, index + 1);
+}
+
+void rejectWithoutTimer(Server *server, int index) {
+  printf("No room for the timers of client %d, closing it\n", index);
+  metricsAdd(METRIC_REJECT_NO_TIMER, 1);
+  closeClient(server, index);
+}
+
+int setupAdminSocket(int port) {
+  int admin_fd;
+  struct sockaddr_in address;
+  int opt = 1;
+
+  if ((admin_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    perror("admin socket failed");
+    return -1;
+  }
+  setsockopt(admin_fd, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt));
+
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  if (bind(admin_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(admin_fd, MAX_ADMIN_CLIENTS) < 0) {
+    perror("admin bind failed, metrics disabled");
+    close(admin_fd);
+    return -1;
+  }
+  fcntl(admin_fd, F_SETFL, O_NONBLOCK);
+  return admin_fd;
+}
+
+void acceptAdminClient(Server *server) {
+  int admin_socket = accept(server->admin_fd, NULL, NULL);
+  if (admin_socket < 0) {
+    return;
+  }
+  for (int i = 0; i < MAX_ADMIN_CLIENTS; i++) {
+    if (server->admin_clients[i] == 0 && admin_socket < FD_SETSIZE) {
+      fcntl(admin_socket, F_SETFL, O_NONBLOCK);
+      int timer = timerWheelAdd(&server->timers, ADMIN_TIMEOUT_MS,
+                                TIMER_ADMIN, i);
+      if (timer == -1) {
+        break;
+      }
+      server->admin_clients[i] = admin_socket;
+      server->admin_timers[i] = timer;
+      return;
+    }
+  }
+  close(admin_socket);
+}
+
+void serveMetrics(Server *server, int index) {
+  char request[BUFFER_SIZE];
+  int admin_socket = server->admin_clients[index];
+  if (recv(admin_socket, request, sizeof(request), 0) > 0) {
+    char *response = (char *)malloc(METRICS_BUFFER_SIZE);
+    if (response != NULL) {
+      int header = sprintf(response,
+                           "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Connection: close\r\n\r\n");
+      size_t length =
+          header + metricsFormat(response + header,
+                                 METRICS_BUFFER_SIZE - header);
+      send(admin_socket, response, length, MSG_NOSIGNAL);
+      free(response);
+    }
+  }
+  timerWheelCancel(&server->timers, server->admin_timers[index]);
+  close(admin_socket);
+  server->admin_clients[index] = 0;
+  server->admin_timers[index] = -1;
+}
+
+ssize_t sendToClient(ClientData *client, const char *message, size_t length) {
+  ssize_t sent =
+      client->transport == TRANSPORT_SHM
+          ? shmRingSend(&client->channel->toClient, client->notifyFd, message,
+                        length)
+          : send(client->socket, message, length, MSG_NOSIGNAL);
+  if (sent > 0) {
+    metricsAdd(METRIC_BYTES_OUT, sent);
+  }
+  return sent;
+}
+
+ssize_t recvFromClient(ClientData *client, char *buffer, size_t length) {
+  ssize_t received =
+      client->transport == TRANSPORT_SHM
+          ? shmRingRecv(&client->channel->toServer, client->socket, buffer,
+                        length)
+          : recv(client->socket, buffer, length, 0);
+  if (received > 0) {
+    metricsAdd(METRIC_BYTES_IN, received);
+  }
+  return received;
+}
+
+void onTimerExpired(int kind, int owner, void *ctx) {
+  Server *server = (Server *)ctx;
+  if (kind == TIMER_ADMIN) {
+    close(server->admin_clients[owner]);
+    server->admin_clients[owner] = 0;
+    server->admin_timers[owner] = -1;
+    return;
+  }
+
+  ClientData *client_data = &server->client_data[owner];
+  if (kind == TIMER_HANDSHAKE) {
+    client_data->limitTimer = -1;
+    metricsAdd(METRIC_REJECT_HANDSHAKE_TIMEOUT, 1);
+    printf("No data within the timeout period.\n");
+  } else {
+    if (kind == TIMER_IDLE) {
+      client_data->idleTimer = -1;
+      printf("Idle timeout, client %s. ", client_data->name);
+    } else {
+      client_data->limitTimer = -1;
+      printf("Game time limit reached, client %s. ", client_data->name);
+    }
+    metricsAdd(METRIC_GAMES_TIMEOUT, 1);
+    finishGame(server, owner, WAL_RESULT_TIMEOUT);
+    sendToClient(client_data, "t", 1);
+  }
+  closeClient(server, owner);
+}
+
+void onReloadSignal(int signo) {
+  (void)signo;
+  reload_requested = 1;
+}
+
+void onShutdownSignal(int signo) {
+  (void)signo;
+  shutdown_requested = 1;
+}
+
+void reloadConfig(Server *server) {
+  if (server->config_path == NULL) {
+    printf("No config file to reload\n");
+    return;
+  }
+  int seed, port;
+  GameData gameData;
+  if (readData(server->config_path, &seed, &port, &gameData) == -1) {
+    printf("Config reload failed, keeping current settings\n");
+    return;
+  }
+  if (port != server->port) {
+    printf("Port change requires a restart, keeping port %d\n",
+           server->port);
+  }
+  server->seed = seed;
+  server->gameData = gameData;
+  printf("Config reloaded: attempts %d - %d, range %d - %d .. %d - %d\n",
+         gameData.minattempts, gameData.maxattempts, gameData.mininit,
+         gameData.maxinit, gameData.minfin, gameData.maxfin);
+}
+
+int setupUnixSocket(const char *path, int type, int backlog) {
+  struct sockaddr_un address;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    printf("Unix socket path %s is too long\n", path);
+    return -1;
+  }
+
+  int unix_fd = socket(AF_UNIX, type, 0);
+  if (unix_fd < 0) {
+    perror("unix socket failed");
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  unlink(path);
+  if (bind(unix_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(unix_fd, backlog) < 0) {
+    perror("unix bind failed");
+    close(unix_fd);
+    return -1;
+  }
+  fcntl(unix_fd, F_SETFL, O_NONBLOCK);
+  return unix_fd;
+}
+
+int setupHandoverSocket(const char *path) {
+  return setupUnixSocket(path, SOCK_SEQPACKET, 1);
+}
+
+int sendWithFds(int sock, const void *data, size_t length, const int *fds,
+                int count) {
+  struct iovec iov = {(void *)data, length};
+  struct msghdr msg;
+  char control[CMSG_SPACE(sizeof(int) * HANDOVER_BATCH)];
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (count > 0) {
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+  }
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)length ? 0 : -1;
+}
+
+ssize_t recvWithFds(int sock, void *data, size_t length, int *fds,
+                    int *count) {
+  struct iovec iov = {data, length};
+  struct msghdr msg;
+  char control[CMSG_SPACE(sizeof(int) * HANDOVER_BATCH)];
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  int capacity = *count;
+  *count = 0;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (int i = 0; i < n; i++) {
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        if (*count < capacity) {
+          fds[(*count)++] = fd;
+        } else {
+          close(fd);
+        }
+      }
+    }
+  }
+  if (received <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+    return -1;
+  }
+  return received;
+}
+
+void performHandover(Server *server) {
+  int conn = accept(server->handover_fd, NULL, NULL);
+  if (conn < 0) {
+    return;
+  }
+  fcntl(conn, F_SETFL, 0);
+  struct timeval tv = {HANDOVER_TIMEOUT_S, 0};
+  setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  // The new process rebuilds the leaderboard from the log
+  if (server->wal_path != NULL && walSync(&server->wal) == -1) {
+    printf("Log is not synced, refusing handover\n");
+    close(conn);
+    return;
+  }
+
+  HandoverHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = HANDOVER_MAGIC;
+  header.version = HANDOVER_VERSION;
+  header.hasAdmin = server->admin_fd != -1;
+  header.hasUnix = server->unix_fd != -1;
+  header.seed = server->seed;
+  header.port = server->port;
+  header.nextSessionId = server->nextSessionId;
+  header.gameData = server->gameData;
+  for (int i = 0; i < server->client_capacity; i++) {
+    if (server->client_data[i].socket > 0) {
+      header.sessions++;
+    }
+  }
+
+  printf("Handing over %d sessions\n", header.sessions);
+  int listeners[3] = {server->server_fd};
+  int listenerCount = 1;
+  if (header.hasAdmin) {
+    listeners[listenerCount++] = server->admin_fd;
+  }
+  if (header.hasUnix) {
+    listeners[listenerCount++] = server->unix_fd;
+  }
+  int ok = sendWithFds(conn, &header, sizeof(header), listeners,
+                       listenerCount) == 0;
+
+  HandoverSession *batch =
+      (HandoverSession *)calloc(HANDOVER_BATCH, sizeof(HandoverSession));
+  int fds[HANDOVER_BATCH];
+  int count = 0, fdCount = 0;
+  ok = ok && batch != NULL;
+  for (int i = 0; ok && i <= server->client_capacity; i++) {
+    ClientData *client = NULL;
+    if (i < server->client_capacity && server->client_data[i].socket > 0) {
+      client = &server->client_data[i];
+    }
+    int needed = client == NULL                        ? 0
+                 : client->transport == TRANSPORT_SHM ? SHM_CHANNEL_FDS
+                                                      : 1;
+    if (count > 0 && (i == server->client_capacity || count == HANDOVER_BATCH ||
+                      fdCount + needed > HANDOVER_BATCH)) {
+      ok = sendWithFds(conn, batch, count * sizeof(HandoverSession), fds,
+                       fdCount) == 0;
+      count = 0;
+      fdCount = 0;
+    }
+    if (ok && client != NULL) {
+      HandoverSession *record = &batch[count++];
+      record->sessionId = client->sessionId;
+      record->acceptedAt = client->acceptedAt;
+      record->idleRemaining =
+          timerWheelRemaining(&server->timers, client->idleTimer);
+      record->limitRemaining =
+          timerWheelRemaining(&server->timers, client->limitTimer);
+      record->state = client->state;
+      record->transport = client->transport;
+      record->min = client->min;
+      record->max = client->max;
+      record->secretNumber = client->secretNumber;
+      record->attempts = client->attempts;
+      record->moves = client->moves;
+      memcpy(record->name, client->name, BUFFER_SIZE);
+      fds[fdCount++] = client->socket;
+      if (client->transport == TRANSPORT_SHM) {
+        fds[fdCount++] = client->notifyFd;
+        fds[fdCount++] = client->channelFd;
+      }
+    }
+  }
+  free(batch);
+
+  char ack = 0;
+  if (ok && recv(conn, &ack, 1, 0) == 1 && ack == 'A') {
+    printf("Handover complete, exiting\n");
+    exit(EXIT_SUCCESS);
+  }
+  printf("Handover failed, continuing to serve\n");
+  close(conn);
+}
+
+int receiveHandover(Server *server) {
+  struct sockaddr_un address;
+  int conn = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (conn < 0 || strlen(server->handover_path) >= sizeof(address.sun_path)) {
+    printf("Handover socket error\n");
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, server->handover_path);
+  if (connect(conn, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("handover connect");
+    close(conn);
+    return -1;
+  }
+
+  HandoverHeader header;
+  int listeners[3];
+  int count = 3;
+  if (recvWithFds(conn, &header, sizeof(header), listeners, &count) !=
+          sizeof(header) ||
+      header.magic != HANDOVER_MAGIC || header.version != HANDOVER_VERSION ||
+      count != 1 + (header.hasAdmin != 0) + (header.hasUnix != 0)) {
+    printf("Invalid handover header\n");
+    close(conn);
+    return -1;
+  }
+  server->server_fd = listeners[0];
+  server->admin_fd = header.hasAdmin ? listeners[1] : -1;
+  server->unix_fd = header.hasUnix ? listeners[count - 1] : -1;
+  server->port = header.port;
+  server->nextSessionId = header.nextSessionId;
+  if (server->config_path == NULL) {
+    server->seed = header.seed;
+    server->gameData = header.gameData;
+  }
+
+  int capacity = server->client_capacity;
+  while (capacity < header.sessions) {
+    capacity *= 2;
+  }
+  if (capacity != server->client_capacity) {
+    ClientData *resized = (ClientData *)realloc(
+        server->client_data, capacity * sizeof(ClientData));
+    if (resized == NULL) {
+      printf("Out of memory\n");
+      close(conn);
+      return -1;
+    }
+    server->client_data = resized;
+    initializeClientData(server->client_data, server->client_capacity,
+                         capacity);
+    server->client_capacity = capacity;
+  }
+
+  HandoverSession *batch =
+      (HandoverSession *)calloc(HANDOVER_BATCH, sizeof(HandoverSession));
+  int received = 0;
+  int slots = 0;
+  while (batch != NULL && received < header.sessions) {
+    int fds[HANDOVER_BATCH];
+    int fdCount = HANDOVER_BATCH;
+    ssize_t length = recvWithFds(conn, batch,
+                                 HANDOVER_BATCH * sizeof(HandoverSession),
+                                 fds, &fdCount);
+    int records = length > 0 ? (int)(length / sizeof(HandoverSession)) : 0;
+    int expected = 0;
+    for (int i = 0; i < records; i++) {
+      expected += batch[i].transport == TRANSPORT_SHM ? SHM_CHANNEL_FDS : 1;
+    }
+    if (records == 0 || expected != fdCount ||
+        received + records > header.sessions) {
+      for (int i = 0; i < fdCount; i++) {
+        close(fds[i]);
+      }
+      break;
+    }
+    for (int i = 0, fd = 0; i < records; i++, received++) {
+      HandoverSession *record = &batch[i];
+      int *sessionFds = &fds[fd];
+      int sessionFdCount =
+          record->transport == TRANSPORT_SHM ? SHM_CHANNEL_FDS : 1;
+      fd += sessionFdCount;
+      // A session this process cannot select() on, whose channel does not
+      // map or whose deadlines cannot be armed is dropped; its client sees
+      // the connection close
+      int usable = 1;
+      for (int j = 0; j < sessionFdCount; j++) {
+        usable = usable && sessionFds[j] < FD_SETSIZE;
+      }
+      ShmChannel *channel = NULL;
+      if (usable && record->transport == TRANSPORT_SHM) {
+        channel = shmChannelMap(sessionFds[2]);
+        usable = channel != NULL;
+      }
+      int index = slots;
+      int idleTimer = -1;
+      int limitTimer = -1;
+      if (usable && record->idleRemaining >= 0) {
+        idleTimer = timerWheelAdd(&server->timers, record->idleRemaining,
+                                  TIMER_IDLE, index);
+        usable = idleTimer != -1;
+      }
+      if (usable && record->limitRemaining >= 0) {
+        limitTimer = timerWheelAdd(
+            &server->timers, record->limitRemaining,
+            record->state == SESSION_HANDSHAKE ? TIMER_HANDSHAKE : TIMER_GAME,
+            index);
+        usable = limitTimer != -1;
+      }
+      if (!usable) {
+        if ((record->idleRemaining >= 0 && idleTimer == -1) ||
+            (record->limitRemaining >= 0 && limitTimer == -1)) {
+          metricsAdd(METRIC_REJECT_NO_TIMER, 1);
+        }
+        timerWheelCancel(&server->timers, idleTimer);
+        timerWheelCancel(&server->timers, limitTimer);
+        shmChannelUnmap(channel);
+        for (int j = 0; j < sessionFdCount; j++) {
+          close(sessionFds[j]);
+        }
+        continue;
+      }
+
+      slots++;
+      ClientData *client = &server->client_data[index];
+      client->socket = sessionFds[0];
+      client->transport = (Transport)record->transport;
+      if (client->transport == TRANSPORT_SHM) {
+        client->notifyFd = sessionFds[1];
+        client->channelFd = sessionFds[2];
+        client->channel = channel;
+      }
+      client->state = (SessionState)record->state;
+      client->sessionId = record->sessionId;
+      client->acceptedAt = record->acceptedAt;
+      client->min = record->min;
+      client->max = record->max;
+      client->secretNumber = record->secretNumber;
+      client->attempts = record->attempts;
+      client->moves = record->moves;
+      memcpy(client->name, record->name, BUFFER_SIZE);
+      client->name[BUFFER_SIZE - 1] = '\0';
+      client->idleTimer = idleTimer;
+      client->limitTimer = limitTimer;
+    }
+  }
+  free(batch);
+
+  if (received != header.sessions || send(conn, "A", 1, MSG_NOSIGNAL) != 1) {
+    printf("Handover interrupted after %d of %d sessions\n", received,
+           header.sessions);
+    close(conn);
+    return -1;
+  }
+  close(conn);
+  metricsAdd(METRIC_ACCEPTS, slots);
+  printf("Took over %d sessions\n", slots);
+  if (slots != received) {
+    printf("Dropped %d sessions that could not be served\n", received - slots);
+  }
+  return 0;
+}
+
 int readData(const char *filename, int *seed, int *port, GameData *gameData) {
   FILE *file = fopen(filename, "r");
   if (file == NULL) {
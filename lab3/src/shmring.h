@@ -0,0 +1,128 @@
+/**
+ * @file shmring.h
+ * @brief Shared-memory transport for clients on the server's host.
+ *
+ * A channel is a memfd holding two single-producer single-consumer rings of
+ * fixed-size message slots, one per direction. Every message of the protocol
+ * occupies one slot, so the message boundaries the server relies on are kept,
+ * and an empty message stands for a closed connection. Each direction has an
+ * eventfd the producer signals after publishing a message, which is what the
+ * consumer's select() or epoll waits on.
+ *
+ * A client creates the channel and both eventfds and passes them with
+ * SCM_RIGHTS along with its name over the server's Unix socket. From then on
+ * all messages go through the rings. The memfd is sealed against resizing, so
+ * the client cannot truncate it under the server's mapping; the server maps
+ * only memfds that carry these seals.
+ */
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_RING_SLOTS 16
+#define SHM_SLOT_SIZE 256
+
+/** Descriptors passed with the name: memfd, to-server and to-client eventfd. */
+#define SHM_CHANNEL_FDS 3
+
+/**
+ * @struct ShmRing
+ * @brief Messages flowing in one direction.
+ *
+ * @var ShmRing::head
+ * Number of messages published, written by the producer only.
+ * @var ShmRing::tail
+ * Number of messages consumed, written by the consumer only.
+ * @var ShmRing::lengths
+ * Length of the message in every slot.
+ * @var ShmRing::slots
+ * Message bytes.
+ */
+typedef struct {
+  _Alignas(64) _Atomic uint32_t head;
+  _Alignas(64) _Atomic uint32_t tail;
+  _Alignas(64) uint32_t lengths[SHM_RING_SLOTS];
+  char slots[SHM_RING_SLOTS][SHM_SLOT_SIZE];
+} ShmRing;
+
+/**
+ * @struct ShmChannel
+ * @brief Layout of the shared memory of one session.
+ *
+ * @var ShmChannel::toServer
+ * Messages from the client.
+ * @var ShmChannel::toClient
+ * Messages from the server.
+ */
+typedef struct {
+  ShmRing toServer;
+  ShmRing toClient;
+} ShmChannel;
+
+/**
+ * @brief Creates an empty channel and its two eventfds.
+ * @param fds Receives the memfd and the to-server and to-client eventfds, in
+ * the order they are passed to the server.
+ * @return The mapped channel, or NULL with errno set.
+ */
+ShmChannel *shmChannelCreate(int fds[SHM_CHANNEL_FDS]);
+
+/**
+ * @brief Maps a channel received from a client.
+ * @param fd The channel's memfd.
+ * @return The mapped channel, or NULL if fd is not a channel or is not sealed
+ * against resizing.
+ */
+ShmChannel *shmChannelMap(int fd);
+
+/**
+ * @brief Checks that a descriptor received from a client is an eventfd and
+ * makes it non-blocking.
+ *
+ * The ring functions read and write the eventfds of a channel; any other
+ * descriptor, or a blocking one, could stall the server's event loop.
+ *
+ * @param fd Descriptor to check.
+ * @return 0 if fd is a non-blocking eventfd now, -1 otherwise.
+ */
+int shmEventFdCheck(int fd);
+
+/**
+ * @brief Unmaps a channel.
+ * @param channel Channel to unmap, may be NULL.
+ */
+void shmChannelUnmap(ShmChannel *channel);
+
+/**
+ * @brief Publishes a message and signals the consumer.
+ * @param ring Ring to write to.
+ * @param eventFd Eventfd the consumer waits on.
+ * @param message Message bytes.
+ * @param length Message length, at most SHM_SLOT_SIZE; 0 closes the channel.
+ * @return length, or -1 with errno EAGAIN if the ring is full or EMSGSIZE if
+ * the message does not fit a slot.
+ */
+ssize_t shmRingSend(ShmRing *ring, int eventFd, const char *message,
+                    size_t length);
+
+/**
+ * @brief Takes the next message from a ring.
+ *
+ * The eventfd is reset when the last queued message is taken, and signalled
+ * again if another one arrived meanwhile, so the consumer is woken exactly
+ * as long as messages are queued.
+ *
+ * @param ring Ring to read from.
+ * @param eventFd Eventfd the producer signals.
+ * @param buffer Destination buffer; longer messages are truncated.
+ * @param length Size of the destination buffer.
+ * @return Length of the message, 0 if the peer closed the channel, or -1 with
+ * errno EAGAIN if no message is queued.
+ */
+ssize_t shmRingRecv(ShmRing *ring, int eventFd, char *buffer, size_t length);
+
+#endif
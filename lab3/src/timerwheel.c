@@ -0,0 +1,222 @@
+/**
+ * @file timerwheel.c
+ * @brief Implementation of the hierarchical timer wheel.
+ */
+#include "timerwheel.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#define TW_INITIAL_TIMERS 64
+#define TW_OVERFLOW (TW_LEVELS * TW_SLOTS)
+#define TW_SPAN_BITS (TW_LEVELS * TW_LEVEL_BITS)
+
+uint64_t timerNowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void linkTimer(TimerWheel *tw, int id) {
+  Timer *t = &tw->timers[id];
+  int slot = TW_OVERFLOW;
+  for (int level = 0; level < TW_LEVELS; level++) {
+    int shift = level * TW_LEVEL_BITS;
+    if ((t->expires >> (shift + TW_LEVEL_BITS)) ==
+        (tw->now >> (shift + TW_LEVEL_BITS))) {
+      int index = (int)((t->expires >> shift) & (TW_SLOTS - 1));
+      slot = level * TW_SLOTS + index;
+      tw->occupied[level] |= 1ULL << index;
+      break;
+    }
+  }
+  t->slot = slot;
+  t->prev = -1;
+  t->next = tw->heads[slot];
+  if (t->next != -1) {
+    tw->timers[t->next].prev = id;
+  }
+  tw->heads[slot] = id;
+}
+
+static void unlinkTimer(TimerWheel *tw, int id) {
+  Timer *t = &tw->timers[id];
+  if (t->prev != -1) {
+    tw->timers[t->prev].next = t->next;
+  } else {
+    tw->heads[t->slot] = t->next;
+  }
+  if (t->next != -1) {
+    tw->timers[t->next].prev = t->prev;
+  }
+  if (tw->heads[t->slot] == -1 && t->slot != TW_OVERFLOW) {
+    tw->occupied[t->slot / TW_SLOTS] &= ~(1ULL << (t->slot % TW_SLOTS));
+  }
+}
+
+static void releaseTimer(TimerWheel *tw, int id) {
+  tw->timers[id].slot = -1;
+  tw->timers[id].next = tw->freeList;
+  tw->freeList = id;
+  tw->count--;
+}
+
+static void cascade(TimerWheel *tw, int slot) {
+  int id = tw->heads[slot];
+  tw->heads[slot] = -1;
+  if (slot != TW_OVERFLOW) {
+    tw->occupied[slot / TW_SLOTS] &= ~(1ULL << (slot % TW_SLOTS));
+  }
+  while (id != -1) {
+    int next = tw->timers[id].next;
+    linkTimer(tw, id);
+    id = next;
+  }
+}
+
+static uint64_t nextWakeTick(const TimerWheel *tw) {
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < TW_LEVELS; level++) {
+    if (tw->occupied[level] == 0) {
+      continue;
+    }
+    int shift = level * TW_LEVEL_BITS;
+    uint64_t base = (tw->now >> (shift + TW_LEVEL_BITS))
+                    << (shift + TW_LEVEL_BITS);
+    uint64_t tick =
+        base | ((uint64_t)__builtin_ctzll(tw->occupied[level]) << shift);
+    if (tick < next) {
+      next = tick;
+    }
+  }
+  if (tw->heads[TW_OVERFLOW] != -1) {
+    uint64_t tick = ((tw->now >> TW_SPAN_BITS) + 1) << TW_SPAN_BITS;
+    if (tick < next) {
+      next = tick;
+    }
+  }
+  return next;
+}
+
+int timerWheelInit(TimerWheel *tw, uint64_t nowMs) {
+  tw->now = nowMs / TW_TICK_MS;
+  for (int i = 0; i <= TW_OVERFLOW; i++) {
+    tw->heads[i] = -1;
+  }
+  for (int level = 0; level < TW_LEVELS; level++) {
+    tw->occupied[level] = 0;
+  }
+  tw->capacity = TW_INITIAL_TIMERS;
+  tw->timers = (Timer *)calloc(tw->capacity, sizeof(Timer));
+  if (tw->timers == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < tw->capacity; i++) {
+    tw->timers[i].slot = -1;
+    tw->timers[i].next = i + 1 < tw->capacity ? i + 1 : -1;
+  }
+  tw->freeList = 0;
+  tw->count = 0;
+  return 0;
+}
+
+void timerWheelDestroy(TimerWheel *tw) {
+  free(tw->timers);
+  tw->timers = NULL;
+  tw->capacity = 0;
+  tw->freeList = -1;
+  tw->count = 0;
+}
+
+int timerWheelAdd(TimerWheel *tw, uint64_t delayMs, int kind, int owner) {
+  if (tw->freeList == -1) {
+    int capacity = tw->capacity * 2;
+    Timer *timers = (Timer *)realloc(tw->timers, capacity * sizeof(Timer));
+    if (timers == NULL) {
+      return -1;
+    }
+    for (int i = tw->capacity; i < capacity; i++) {
+      timers[i].slot = -1;
+      timers[i].next = i + 1 < capacity ? i + 1 : -1;
+    }
+    tw->timers = timers;
+    tw->freeList = tw->capacity;
+    tw->capacity = capacity;
+  }
+
+  int id = tw->freeList;
+  Timer *t = &tw->timers[id];
+  tw->freeList = t->next;
+
+  uint64_t ticks = (delayMs + TW_TICK_MS - 1) / TW_TICK_MS;
+  t->expires = tw->now + (ticks > 0 ? ticks : 1);
+  t->kind = kind;
+  t->owner = owner;
+  tw->count++;
+  linkTimer(tw, id);
+  return id;
+}
+
+void timerWheelCancel(TimerWheel *tw, int id) {
+  if (id < 0 || id >= tw->capacity || tw->timers[id].slot == -1) {
+    return;
+  }
+  unlinkTimer(tw, id);
+  releaseTimer(tw, id);
+}
+
+int64_t timerWheelRemaining(const TimerWheel *tw, int id) {
+  if (id < 0 || id >= tw->capacity || tw->timers[id].slot == -1) {
+    return -1;
+  }
+  return (int64_t)(tw->timers[id].expires - tw->now) * TW_TICK_MS;
+}
+
+int timerWheelAdvance(TimerWheel *tw, uint64_t nowMs, TimerCallback cb,
+                      void *ctx) {
+  uint64_t target = nowMs / TW_TICK_MS;
+  int fired = 0;
+
+  while (tw->now < target) {
+    uint64_t next = nextWakeTick(tw);
+    if (next > target) {
+      tw->now = target;
+      break;
+    }
+    tw->now = next;
+
+    if ((tw->now & ((1ULL << TW_SPAN_BITS) - 1)) == 0) {
+      cascade(tw, TW_OVERFLOW);
+    }
+    for (int level = TW_LEVELS - 1; level > 0; level--) {
+      int shift = level * TW_LEVEL_BITS;
+      if ((tw->now & ((1ULL << shift) - 1)) == 0) {
+        cascade(tw, level * TW_SLOTS +
+                        (int)((tw->now >> shift) & (TW_SLOTS - 1)));
+      }
+    }
+
+    int slot = (int)(tw->now & (TW_SLOTS - 1));
+    while (tw->heads[slot] != -1) {
+      int id = tw->heads[slot];
+      int kind = tw->timers[id].kind;
+      int owner = tw->timers[id].owner;
+      unlinkTimer(tw, id);
+      releaseTimer(tw, id);
+      fired++;
+      cb(kind, owner, ctx);
+    }
+  }
+  return fired;
+}
+
+int64_t timerWheelTimeout(const TimerWheel *tw, uint64_t nowMs) {
+  if (tw->count == 0) {
+    return -1;
+  }
+  uint64_t next = nextWakeTick(tw);
+  if (next * TW_TICK_MS <= nowMs) {
+    return 0;
+  }
+  return (int64_t)(next * TW_TICK_MS - nowMs);
+}
@@ -0,0 +1,158 @@
+/**
+ * @file timerwheel.h
+ * @brief Hierarchical timer wheel driving session timeouts in the server.
+ *
+ * Timers are kept in TW_LEVELS wheels of TW_SLOTS slots each. Level 0 slots
+ * are one tick wide, every next level is TW_SLOTS times coarser. Adding and
+ * cancelling a timer is O(1); timers stored on a coarse level are cascaded
+ * down when the wheel reaches their slot. A bitmap of occupied slots per level
+ * lets the wheel report its nearest deadline without walking any timer list,
+ * so the event loop can size its select() timeout without scanning sessions.
+ *
+ * Timer nodes live in a pool owned by the wheel and are linked by index, so
+ * their owners may be moved in memory (e.g. by realloc) without fixups.
+ */
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+#define TW_TICK_MS 10
+#define TW_LEVEL_BITS 6
+#define TW_SLOTS (1 << TW_LEVEL_BITS)
+#define TW_LEVELS 4
+
+/**
+ * @struct Timer
+ * @brief A single timer node of the pool.
+ *
+ * @var Timer::expires
+ * Absolute expiry tick.
+ * @var Timer::prev
+ * Index of the previous node in the slot list, -1 for the list head.
+ * @var Timer::next
+ * Index of the next node in the slot list or in the free list, -1 for the end.
+ * @var Timer::slot
+ * Slot the node is linked into, -1 if the node is free.
+ * @var Timer::kind
+ * Caller-defined timer type passed back on expiry.
+ * @var Timer::owner
+ * Caller-defined owner (e.g. session index) passed back on expiry.
+ */
+typedef struct {
+  uint64_t expires;
+  int prev;
+  int next;
+  int slot;
+  int kind;
+  int owner;
+} Timer;
+
+/**
+ * @struct TimerWheel
+ * @brief Wheel state: current tick, slot lists and the node pool.
+ *
+ * @var TimerWheel::now
+ * Last tick processed by timerWheelAdvance().
+ * @var TimerWheel::heads
+ * Heads of the slot lists, TW_LEVELS * TW_SLOTS wheel slots followed by the
+ * overflow list for timers beyond the top level.
+ * @var TimerWheel::occupied
+ * Bitmap of non-empty slots for each level.
+ * @var TimerWheel::timers
+ * Node pool.
+ * @var TimerWheel::capacity
+ * Size of the node pool.
+ * @var TimerWheel::freeList
+ * Head of the list of free nodes.
+ * @var TimerWheel::count
+ * Number of armed timers.
+ */
+typedef struct {
+  uint64_t now;
+  int heads[TW_LEVELS * TW_SLOTS + 1];
+  uint64_t occupied[TW_LEVELS];
+  Timer *timers;
+  int capacity;
+  int freeList;
+  int count;
+} TimerWheel;
+
+/**
+ * @brief Callback invoked for every expired timer.
+ * @param kind Timer type given to timerWheelAdd().
+ * @param owner Timer owner given to timerWheelAdd().
+ * @param ctx Opaque pointer given to timerWheelAdvance().
+ */
+typedef void (*TimerCallback)(int kind, int owner, void *ctx);
+
+/**
+ * @brief Returns the current monotonic time in milliseconds.
+ * @return Milliseconds since an unspecified starting point.
+ */
+uint64_t timerNowMs(void);
+
+/**
+ * @brief Initializes an empty wheel positioned at the given time.
+ * @param tw Wheel to initialize.
+ * @param nowMs Current time in milliseconds.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int timerWheelInit(TimerWheel *tw, uint64_t nowMs);
+
+/**
+ * @brief Releases the node pool of the wheel.
+ * @param tw Wheel to destroy.
+ */
+void timerWheelDestroy(TimerWheel *tw);
+
+/**
+ * @brief Arms a timer that fires after the given delay.
+ * @param tw Wheel to add the timer to.
+ * @param delayMs Delay in milliseconds relative to the wheel's current tick.
+ * @param kind Caller-defined timer type.
+ * @param owner Caller-defined owner.
+ * @return Timer id to pass to timerWheelCancel(), or -1 on allocation failure.
+ */
+int timerWheelAdd(TimerWheel *tw, uint64_t delayMs, int kind, int owner);
+
+/**
+ * @brief Disarms a timer. Ids of -1 and of already fired timers are ignored.
+ * @param tw Wheel holding the timer.
+ * @param id Timer id returned by timerWheelAdd().
+ */
+void timerWheelCancel(TimerWheel *tw, int id);
+
+/**
+ * @brief Returns the remaining time of a timer.
+ * @param tw Wheel holding the timer.
+ * @param id Timer id returned by timerWheelAdd().
+ * @return Milliseconds until the timer fires, or -1 if it is not armed.
+ */
+int64_t timerWheelRemaining(const TimerWheel *tw, int id);
+
+/**
+ * @brief Moves the wheel forward and fires every timer that became due.
+ *
+ * The timer is released before its callback runs, so the callback may freely
+ * add or cancel timers, including the one that fired.
+ *
+ * @param tw Wheel to advance.
+ * @param nowMs Current time in milliseconds.
+ * @param cb Callback invoked for each expired timer.
+ * @param ctx Opaque pointer passed to the callback.
+ * @return Number of timers fired.
+ */
+int timerWheelAdvance(TimerWheel *tw, uint64_t nowMs, TimerCallback cb,
+                      void *ctx);
+
+/**
+ * @brief Computes how long the event loop may sleep before the next timer.
+ * @param tw Wheel to inspect.
+ * @param nowMs Current time in milliseconds.
+ * @return Milliseconds until the nearest timer or cascade point, or -1 if no
+ * timer is armed.
+ */
+int64_t timerWheelTimeout(const TimerWheel *tw, uint64_t nowMs);
+
+#endif
@@ -0,0 +1,483 @@
+/**
+ * @file wal.c
+ * @brief Implementation of the write-ahead log.
+ *
+ * File layout: a WalFileHeader, then records of a 32-bit body length, the
+ * CRC-32 of the body and the body, which is a WalRecord followed by the name.
+ * Integers are stored in host byte order, which the header records.
+ */
+#define _GNU_SOURCE
+#include "wal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+#define WAL_MAGIC "LAB3WAL\n"
+#define WAL_VERSION 1
+#define WAL_BYTE_ORDER 0x01020304u
+
+/**
+ * @struct WalFileHeader
+ * @brief First bytes of every log file.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+} WalFileHeader;
+
+/** Bytes before the body of a record: its length and checksum. */
+#define RECORD_PREFIX (2 * sizeof(uint32_t))
+#define RECORD_MAX (RECORD_PREFIX + sizeof(WalRecord) + WAL_NAME_MAX)
+
+/**
+ * @struct SessionTable
+ * @brief Unfinished sessions by id during recovery; linear probing, id 0
+ * marks an empty slot.
+ */
+typedef struct {
+  WalSession *slots;
+  size_t size;
+  size_t count;
+} SessionTable;
+
+static uint32_t crcTable[256];
+
+static void crcInit(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? (crc >> 1) ^ 0xedb88320u : crc >> 1;
+    }
+    crcTable[i] = crc;
+  }
+}
+
+static uint32_t crc32(const char *data, size_t length) {
+  uint32_t crc = 0xffffffffu;
+  for (size_t i = 0; i < length; i++) {
+    crc = crcTable[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/* Writes the record with its prefix to out, which holds RECORD_MAX bytes. */
+static size_t encode(char *out, WalRecord *record, const char *name) {
+  record->nameLength = strnlen(name, WAL_NAME_MAX);
+  uint32_t body = sizeof(WalRecord) + record->nameLength;
+  memcpy(out + RECORD_PREFIX, record, sizeof(WalRecord));
+  memcpy(out + RECORD_PREFIX + sizeof(WalRecord), name, record->nameLength);
+  uint32_t crc = crc32(out + RECORD_PREFIX, body);
+  memcpy(out, &body, sizeof(body));
+  memcpy(out + sizeof(body), &crc, sizeof(crc));
+  return RECORD_PREFIX + body;
+}
+
+static int writeAll(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+static size_t homeSlot(uint64_t sessionId, size_t mask) {
+  return (sessionId * 0x9e3779b97f4a7c15ull >> 32) & mask;
+}
+
+static size_t slotOf(const SessionTable *table, uint64_t sessionId) {
+  size_t mask = table->size - 1;
+  size_t slot = homeSlot(sessionId, mask);
+  while (table->slots[slot].sessionId != 0 &&
+         table->slots[slot].sessionId != sessionId) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static int tableGrow(SessionTable *table) {
+  SessionTable grown = {NULL, table->size == 0 ? 64 : table->size * 2, 0};
+  grown.slots = (WalSession *)calloc(grown.size, sizeof(WalSession));
+  if (grown.slots == NULL) {
+    return -1;
+  }
+  for (size_t i = 0; i < table->size; i++) {
+    if (table->slots[i].sessionId != 0) {
+      grown.slots[slotOf(&grown, table->slots[i].sessionId)] =
+          table->slots[i];
+      grown.count++;
+    }
+  }
+  free(table->slots);
+  *table = grown;
+  return 0;
+}
+
+static WalSession *tableFind(const SessionTable *table, uint64_t sessionId) {
+  if (table->count == 0) {
+    return NULL;
+  }
+  WalSession *session = &table->slots[slotOf(table, sessionId)];
+  return session->sessionId == sessionId ? session : NULL;
+}
+
+/* Removes an entry and shifts back the ones probed past it. */
+static void tableRemove(SessionTable *table, WalSession *session) {
+  size_t mask = table->size - 1;
+  size_t hole = session - table->slots;
+  for (size_t next = (hole + 1) & mask; table->slots[next].sessionId != 0;
+       next = (next + 1) & mask) {
+    size_t home = homeSlot(table->slots[next].sessionId, mask);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      table->slots[hole] = table->slots[next];
+      hole = next;
+    }
+  }
+  table->slots[hole].sessionId = 0;
+  table->count--;
+}
+
+static int replay(const WalRecord *record, const char *name,
+                  Leaderboard *board, SessionTable *table) {
+  WalSession *session = tableFind(table, record->sessionId);
+  switch (record->type) {
+    case WAL_GAME_START:
+      if (session == NULL) {
+        if ((table->count + 1) * 2 > table->size && tableGrow(table) == -1) {
+          return -1;
+        }
+        session = &table->slots[slotOf(table, record->sessionId)];
+        table->count++;
+      }
+      session->sessionId = record->sessionId;
+      session->min = record->min;
+      session->max = record->max;
+      session->secretNumber = record->secretNumber;
+      memcpy(session->name, name, record->nameLength);
+      session->name[record->nameLength] = '\0';
+      /* fall through */
+    case WAL_GAME_MOVE:
+      if (session != NULL) {
+        session->attempts = record->attempts;
+        session->moves = record->moves;
+      }
+      return 0;
+    case WAL_GAME_END:
+      if (session != NULL) {
+        tableRemove(table, session);
+      }
+      return leaderboardRecord(board, name,
+                               record->result == WAL_RESULT_VICTORY,
+                               record->attemptsUsed);
+    case WAL_PLAYER:
+      return leaderboardSet(board, name, record->wins, record->games,
+                            record->attemptsUsed);
+    default:
+      return 0;
+  }
+}
+
+/* Reads the log into the board and the table. Returns -1 if the file exists
+ * but is not a log. */
+static int recover(const char *path, Leaderboard *board, SessionTable *table,
+                   uint64_t *maxSessionId) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    perror("wal open");
+    return -1;
+  }
+  struct stat st;
+  char *data = NULL;
+  size_t size = 0;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    size = st.st_size;
+    data = (char *)malloc(size);
+    if (data == NULL || read(fd, data, size) != (ssize_t)size) {
+      printf("Cannot read the log %s\n", path);
+      free(data);
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  if (size == 0) {
+    return 0;
+  }
+
+  WalFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(&header, data, size < sizeof(header) ? size : sizeof(header));
+  if (memcmp(header.magic, WAL_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != WAL_VERSION || header.byteOrder != WAL_BYTE_ORDER) {
+    printf("%s is not a log of this server\n", path);
+    free(data);
+    return -1;
+  }
+
+  size_t offset = sizeof(header);
+  int records = 0;
+  while (offset + RECORD_PREFIX <= size) {
+    uint32_t body, crc;
+    WalRecord record;
+    memcpy(&body, data + offset, sizeof(body));
+    memcpy(&crc, data + offset + sizeof(body), sizeof(crc));
+    const char *start = data + offset + RECORD_PREFIX;
+    if (body < sizeof(WalRecord) || body > sizeof(WalRecord) + WAL_NAME_MAX ||
+        offset + RECORD_PREFIX + body > size || crc32(start, body) != crc) {
+      break;
+    }
+    memcpy(&record, start, sizeof(record));
+    if (record.nameLength != body - sizeof(WalRecord)) {
+      break;
+    }
+    char name[WAL_NAME_MAX + 1];
+    memcpy(name, start + sizeof(record), record.nameLength);
+    name[record.nameLength] = '\0';
+    if (replay(&record, name, board, table) == -1) {
+      printf("Out of memory\n");
+      free(data);
+      return -1;
+    }
+    if (record.sessionId > *maxSessionId) {
+      *maxSessionId = record.sessionId;
+    }
+    offset += RECORD_PREFIX + body;
+    records++;
+  }
+  if (offset != size) {
+    printf("Log %s: dropping %zu bytes of a torn or corrupt record\n", path,
+           size - offset);
+  }
+  printf("Replayed %d records from %s\n", records, path);
+  free(data);
+  return 0;
+}
+
+/* Writes the snapshot to a new file, syncs it and renames it over the log.
+ * Returns the new file's descriptor, opened for appending. */
+static int checkpoint(const char *path, const Leaderboard *board,
+                      const SessionTable *table) {
+  char temp[4096], directory[4096];
+  if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int)sizeof(temp)) {
+    printf("Log path %s is too long\n", path);
+    return -1;
+  }
+  int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    perror("wal checkpoint");
+    return -1;
+  }
+
+  size_t capacity = sizeof(WalFileHeader) +
+                    (board->count + table->count + 1) * RECORD_MAX;
+  char *data = (char *)malloc(capacity);
+  int ok = data != NULL;
+  if (ok) {
+    WalFileHeader header = {WAL_MAGIC, WAL_VERSION, WAL_BYTE_ORDER};
+    memcpy(data, &header, sizeof(header));
+    size_t length = sizeof(header);
+    for (int rank = 1; rank <= board->count; rank++) {
+      const LeaderboardEntry *entry = leaderboardAt(board, rank);
+      WalRecord record = {.type = WAL_PLAYER,
+                          .wins = entry->wins,
+                          .games = entry->games,
+                          .attemptsUsed = entry->attemptsUsed};
+      length += encode(data + length, &record, entry->name);
+    }
+    for (size_t i = 0; i < table->size; i++) {
+      const WalSession *session = &table->slots[i];
+      if (session->sessionId != 0) {
+        WalRecord record = {.type = WAL_GAME_START,
+                            .sessionId = session->sessionId,
+                            .min = session->min,
+                            .max = session->max,
+                            .secretNumber = session->secretNumber,
+                            .attempts = session->attempts,
+                            .moves = session->moves};
+        length += encode(data + length, &record, session->name);
+      }
+    }
+    ok = writeAll(fd, data, length) == 0 && fsync(fd) == 0 &&
+         rename(temp, path) == 0;
+  }
+  free(data);
+  if (!ok) {
+    perror("wal checkpoint");
+    close(fd);
+    unlink(temp);
+    return -1;
+  }
+
+  // The rename itself is only durable once the directory is synced
+  snprintf(directory, sizeof(directory), "%s", path);
+  int dirFd = open(dirname(directory), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd >= 0) {
+    fsync(dirFd);
+    close(dirFd);
+  }
+  return fd;
+}
+
+static void *writerThread(void *arg) {
+  Wal *wal = (Wal *)arg;
+  pthread_mutex_lock(&wal->lock);
+  while (1) {
+    while (wal->length == 0 && !wal->stop) {
+      pthread_cond_wait(&wal->wake, &wal->lock);
+    }
+    if (wal->length == 0) {
+      break;
+    }
+    // Take the whole buffer; records appended while it is written and
+    // synced go to the other one and form the next commit
+    char *data = wal->buffer;
+    size_t length = wal->length;
+    wal->buffer = wal->spare;
+    wal->spare = data;
+    size_t capacity = wal->capacity;
+    wal->capacity = wal->spareCapacity;
+    wal->spareCapacity = capacity;
+    wal->length = 0;
+    uint64_t target = wal->appended;
+    int failed = wal->failed;
+    pthread_mutex_unlock(&wal->lock);
+
+    uint64_t start = metricsNowUs();
+    if (!failed && (writeAll(wal->fd, data, length) == -1 ||
+                    fdatasync(wal->fd) == -1)) {
+      perror("wal write, game results are no longer logged");
+      failed = 1;
+    }
+    metricsAdd(METRIC_WAL_COMMITS, 1);
+    metricsObserve(METRIC_WAL_COMMIT_TIME, metricsNowUs() - start);
+
+    pthread_mutex_lock(&wal->lock);
+    wal->failed = failed;
+    wal->durable = target;
+    pthread_cond_broadcast(&wal->synced);
+  }
+  pthread_mutex_unlock(&wal->lock);
+  return NULL;
+}
+
+int walOpen(Wal *wal, const char *path, Leaderboard *board,
+            WalSession **sessions, int *count, uint64_t *maxSessionId) {
+  memset(wal, 0, sizeof(*wal));
+  crcInit();
+  *sessions = NULL;
+  *count = 0;
+  *maxSessionId = 0;
+
+  SessionTable table = {NULL, 0, 0};
+  if (tableGrow(&table) == -1 ||
+      recover(path, board, &table, maxSessionId) == -1 ||
+      (wal->fd = checkpoint(path, board, &table)) == -1) {
+    free(table.slots);
+    return -1;
+  }
+
+  if (table.count > 0) {
+    *sessions = (WalSession *)malloc(table.count * sizeof(WalSession));
+    for (size_t i = 0; *sessions != NULL && i < table.size; i++) {
+      if (table.slots[i].sessionId != 0) {
+        (*sessions)[(*count)++] = table.slots[i];
+      }
+    }
+  }
+  free(table.slots);
+
+  pthread_mutex_init(&wal->lock, NULL);
+  pthread_cond_init(&wal->wake, NULL);
+  pthread_cond_init(&wal->synced, NULL);
+  // The writer starts with every signal blocked, so that signals meant for
+  // the event loop are never delivered to it instead
+  sigset_t all, saved;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &saved);
+  int started = pthread_create(&wal->thread, NULL, writerThread, wal);
+  pthread_sigmask(SIG_SETMASK, &saved, NULL);
+  if (started != 0) {
+    printf("Cannot start the log writer\n");
+    close(wal->fd);
+    free(*sessions);
+    *sessions = NULL;
+    *count = 0;
+    return -1;
+  }
+  return 0;
+}
+
+void walAppend(Wal *wal, WalRecord *record, const char *name) {
+  char encoded[RECORD_MAX];
+  size_t length = encode(encoded, record, name);
+  pthread_mutex_lock(&wal->lock);
+  if (wal->length + length > wal->capacity) {
+    size_t capacity = wal->capacity == 0 ? 65536 : wal->capacity;
+    while (capacity < wal->length + length) {
+      capacity *= 2;
+    }
+    char *grown = (char *)realloc(wal->buffer, capacity);
+    if (grown == NULL) {
+      pthread_mutex_unlock(&wal->lock);
+      printf("Out of memory, log record dropped\n");
+      return;
+    }
+    wal->buffer = grown;
+    wal->capacity = capacity;
+  }
+  // The writer only sleeps on an empty buffer, so only the first record of
+  // a commit needs to wake it
+  if (wal->length == 0) {
+    pthread_cond_signal(&wal->wake);
+  }
+  memcpy(wal->buffer + wal->length, encoded, length);
+  wal->length += length;
+  wal->appended += length;
+  pthread_mutex_unlock(&wal->lock);
+  metricsAdd(METRIC_WAL_RECORDS, 1);
+}
+
+int walSync(Wal *wal) {
+  pthread_mutex_lock(&wal->lock);
+  uint64_t target = wal->appended;
+  while (wal->durable < target) {
+    pthread_cond_wait(&wal->synced, &wal->lock);
+  }
+  int failed = wal->failed;
+  pthread_mutex_unlock(&wal->lock);
+  return failed ? -1 : 0;
+}
+
+void walClose(Wal *wal) {
+  pthread_mutex_lock(&wal->lock);
+  wal->stop = 1;
+  pthread_cond_signal(&wal->wake);
+  pthread_mutex_unlock(&wal->lock);
+  pthread_join(wal->thread, NULL);
+  close(wal->fd);
+  free(wal->buffer);
+  free(wal->spare);
+  pthread_mutex_destroy(&wal->lock);
+  pthread_cond_destroy(&wal->wake);
+  pthread_cond_destroy(&wal->synced);
+}
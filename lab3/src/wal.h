@@ -0,0 +1,215 @@
+/**
+ * @file wal.h
+ * @brief Write-ahead log of game outcomes and session state.
+ *
+ * The log is a file of checksummed records appended in the order the server
+ * makes its decisions: a game started, a question was answered, a game ended.
+ * Appending only copies the record into a memory buffer; a writer thread
+ * takes everything buffered so far, writes it and calls fdatasync(), so the
+ * event loop never waits for the disk and all records arriving during one
+ * sync share the next one (group commit). Responses are not held back until
+ * their record is durable: a crash may lose the last few milliseconds of
+ * moves, never a record in the middle of the log.
+ *
+ * Opening the log replays it into the leaderboard and the set of unfinished
+ * sessions, stopping at the first torn or corrupt record, and then replaces
+ * it with a snapshot of that state, so the log only grows with the work done
+ * since the server started.
+ */
+#ifndef WAL_H
+#define WAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "leaderboard.h"
+
+/** Longest player name stored in the log. */
+#define WAL_NAME_MAX 255
+
+/**
+ * @enum WalRecordType
+ * @brief Kinds of log records.
+ */
+typedef enum {
+  WAL_GAME_START = 1, /**< Session got its game; all game fields are set. */
+  WAL_GAME_MOVE,      /**< Question answered; attempts and moves are set. */
+  WAL_GAME_END,       /**< Game over; result and attemptsUsed are set. */
+  WAL_PLAYER          /**< Snapshot of a player's leaderboard record. */
+} WalRecordType;
+
+/**
+ * @enum WalResult
+ * @brief How a game ended.
+ */
+typedef enum {
+  WAL_RESULT_VICTORY,  /**< Final guess was right. */
+  WAL_RESULT_DEFEAT,   /**< Final guess was wrong. */
+  WAL_RESULT_TIMEOUT,  /**< Idle timeout or game time limit. */
+  WAL_RESULT_ABANDONED /**< Player disconnected. */
+} WalResult;
+
+/**
+ * @struct WalRecord
+ * @brief Fixed part of a record; the player name follows it in the file.
+ *
+ * @var WalRecord::type
+ * One of WalRecordType.
+ * @var WalRecord::result
+ * One of WalResult, for WAL_GAME_END.
+ * @var WalRecord::sessionId
+ * Session the record belongs to, 0 for WAL_PLAYER.
+ * @var WalRecord::min
+ * The minimum number in the range for guessing.
+ * @var WalRecord::max
+ * The maximum number in the range for guessing.
+ * @var WalRecord::secretNumber
+ * The secret number of the game.
+ * @var WalRecord::attempts
+ * The number of attempts left.
+ * @var WalRecord::moves
+ * Questions answered so far.
+ * @var WalRecord::wins
+ * Games won, for WAL_PLAYER.
+ * @var WalRecord::games
+ * Games finished, for WAL_PLAYER.
+ * @var WalRecord::nameLength
+ * Length of the name following the record; set by walAppend().
+ * @var WalRecord::attemptsUsed
+ * Questions and guesses of the game, or over all games for WAL_PLAYER.
+ */
+typedef struct {
+  uint32_t type;
+  uint32_t result;
+  uint64_t sessionId;
+  int32_t min;
+  int32_t max;
+  int32_t secretNumber;
+  int32_t attempts;
+  uint32_t moves;
+  uint32_t wins;
+  uint32_t games;
+  uint32_t nameLength;
+  uint64_t attemptsUsed;
+} WalRecord;
+
+/**
+ * @struct WalSession
+ * @brief A game found unfinished when the log was opened.
+ *
+ * @var WalSession::sessionId
+ * Server-wide sequence number of the session.
+ * @var WalSession::min
+ * The minimum number in the range for guessing.
+ * @var WalSession::max
+ * The maximum number in the range for guessing.
+ * @var WalSession::secretNumber
+ * The secret number of the game.
+ * @var WalSession::attempts
+ * The number of attempts left.
+ * @var WalSession::moves
+ * Questions answered so far.
+ * @var WalSession::name
+ * The player's name.
+ */
+typedef struct {
+  uint64_t sessionId;
+  int32_t min;
+  int32_t max;
+  int32_t secretNumber;
+  int32_t attempts;
+  uint32_t moves;
+  char name[WAL_NAME_MAX + 1];
+} WalSession;
+
+/**
+ * @struct Wal
+ * @brief An open log and its writer thread.
+ *
+ * @var Wal::fd
+ * Log file, opened for appending.
+ * @var Wal::thread
+ * Writer thread.
+ * @var Wal::lock
+ * Protects all fields below.
+ * @var Wal::wake
+ * Signalled when records are buffered or the log is closed.
+ * @var Wal::synced
+ * Broadcast after every sync.
+ * @var Wal::buffer
+ * Records appended since the writer last took them.
+ * @var Wal::length
+ * Bytes in buffer.
+ * @var Wal::capacity
+ * Size of buffer.
+ * @var Wal::spare
+ * Buffer the writer writes from, swapped with buffer.
+ * @var Wal::spareCapacity
+ * Size of spare.
+ * @var Wal::appended
+ * Bytes appended since the log was opened.
+ * @var Wal::durable
+ * Bytes of those written and synced.
+ * @var Wal::stop
+ * Set by walClose() to end the writer thread.
+ * @var Wal::failed
+ * Set once a write or sync failed; the log is given up then.
+ */
+typedef struct {
+  int fd;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t synced;
+  char *buffer;
+  size_t length;
+  size_t capacity;
+  char *spare;
+  size_t spareCapacity;
+  uint64_t appended;
+  uint64_t durable;
+  int stop;
+  int failed;
+} Wal;
+
+/**
+ * @brief Recovers the log at path, compacts it and starts the writer thread.
+ *
+ * Finished games are added to the leaderboard; the games left unfinished are
+ * returned. A missing file starts an empty log.
+ *
+ * @param wal Log to open.
+ * @param path Filesystem path of the log.
+ * @param board Leaderboard receiving the players' records.
+ * @param sessions Receives a malloc()ed array of the unfinished games, NULL
+ * if there are none.
+ * @param count Receives the number of unfinished games.
+ * @param maxSessionId Receives the highest session id found in the log.
+ * @return 0 on success, -1 if the file is not a log or cannot be written.
+ */
+int walOpen(Wal *wal, const char *path, Leaderboard *board,
+            WalSession **sessions, int *count, uint64_t *maxSessionId);
+
+/**
+ * @brief Buffers a record for the writer thread; never waits for the disk.
+ * @param wal Open log.
+ * @param record Record to append; nameLength is filled in.
+ * @param name Player name, truncated to WAL_NAME_MAX.
+ */
+void walAppend(Wal *wal, WalRecord *record, const char *name);
+
+/**
+ * @brief Waits until every record appended so far is on disk.
+ * @param wal Open log.
+ * @return 0 on success, -1 if the log has failed.
+ */
+int walSync(Wal *wal);
+
+/**
+ * @brief Syncs the remaining records, stops the writer and closes the file.
+ * @param wal Open log.
+ */
+void walClose(Wal *wal);
+
+#endif